@@ -0,0 +1,378 @@
+/// @file compile_bench.cc
+/// @brief Compile-time benchmark of the global value hiding pass.
+///
+/// Generates synthetic modules with a configurable number of globals,
+/// functions, uses per global and loop depth, runs the collector, encryptor
+/// and replacer phases one by one and the whole pass on a fresh copy, and
+/// writes wall time, peak RSS and instructions added per phase as JSON,
+/// along with the pass statistics of the whole-pass run. Every run of a
+/// configuration happens in a child process of its own, so its peak RSS is
+/// not masked by the configurations measured before it.
+///
+/// Every `-gvhide-*` option of the pass is accepted as well, so policies can
+/// be benchmarked without rebuilding.
+
+#include "gv_hide.h"
+#include <chrono>
+#include <cstdint>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/raw_ostream.h>
+#include <memory>
+#include <optional>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace llvm;
+
+static cl::list<unsigned> Globals("globals", cl::CommaSeparated,
+                                  cl::desc("Global variable counts to sweep"));
+static cl::list<unsigned> Functions("functions", cl::CommaSeparated,
+                                    cl::desc("Function counts to sweep"));
+static cl::list<unsigned> UsesPerGlobal("uses-per-global", cl::CommaSeparated,
+                                        cl::desc("Uses per global to sweep"));
+static cl::list<unsigned> LoopDepth("loop-depth", cl::CommaSeparated,
+                                    cl::desc("Loop nest depths to sweep"));
+static cl::opt<unsigned> Repeat("repeat", cl::init(1),
+                                cl::desc("Runs per configuration"));
+static cl::opt<bool> Verify("verify", cl::init(false),
+                            cl::desc("Verify every module after the pass"));
+static cl::opt<std::string> Output("o", cl::init("-"),
+                                   cl::desc("JSON output file"),
+                                   cl::value_desc("filename"));
+
+namespace {
+
+/// @brief Shape of one synthetic module.
+struct BenchConfig {
+  unsigned globals;
+  unsigned functions;
+  unsigned usesPerGlobal;
+  unsigned loopDepth;
+};
+
+/// @brief Measurements of one phase.
+struct PhaseResult {
+  std::string phase;
+  double wallMs;
+  long peakRssKb;     ///< High-water mark of the run's process after the phase.
+  long rssGrowthKb;   ///< How much the phase raised that high-water mark.
+  int64_t instructionsAdded;
+};
+
+/// @brief Measurements of one configuration.
+struct ConfigResult {
+  std::vector<PhaseResult> phases;
+  std::vector<std::pair<std::string, unsigned>> statistics;
+};
+
+/// @brief Builds a synthetic module.
+///
+/// Global `g<i>` is loaded `usesPerGlobal` times from function
+/// `f<i % functions>`, and every function calls `usesPerGlobal` of its
+/// successors. All uses sit in the innermost block of a `loopDepth` deep loop
+/// nest.
+std::unique_ptr<Module> generateModule(LLVMContext &ctx,
+                                       const BenchConfig &cfg) {
+#if LLVM_VERSION_MAJOR < 15
+  // the pass emits opaque pointers; LLVM 14 contexts default to typed ones
+  ctx.enableOpaquePointers();
+#endif
+  auto M = std::make_unique<Module>("gvhide_bench", ctx);
+  auto i64Ty = Type::getInt64Ty(ctx);
+  auto fnTy = FunctionType::get(Type::getVoidTy(ctx), false);
+
+  std::vector<GlobalVariable *> gvs;
+  for (unsigned i = 0; i < cfg.globals; ++i) {
+    gvs.push_back(new GlobalVariable(*M, i64Ty, false,
+                                     GlobalValue::ExternalLinkage,
+                                     ConstantInt::get(i64Ty, 0),
+                                     "g" + std::to_string(i)));
+  }
+
+  std::vector<Function *> fns;
+  for (unsigned j = 0; j < cfg.functions; ++j) {
+    fns.push_back(Function::Create(fnTy, GlobalValue::ExternalLinkage,
+                                   "f" + std::to_string(j), *M));
+  }
+
+  for (unsigned j = 0; j < cfg.functions; ++j) {
+    auto F = fns[j];
+    IRBuilder<> IRB(BasicBlock::Create(ctx, "entry", F));
+
+    // open the loop nest
+    std::vector<std::pair<BasicBlock *, PHINode *>> loops;
+    for (unsigned d = 0; d < cfg.loopDepth; ++d) {
+      auto preheader = IRB.GetInsertBlock();
+      auto header = BasicBlock::Create(ctx, "loop" + std::to_string(d), F);
+      IRB.CreateBr(header);
+      IRB.SetInsertPoint(header);
+      auto phi = IRB.CreatePHI(i64Ty, 2, "i" + std::to_string(d));
+      phi->addIncoming(IRB.getInt64(0), preheader);
+      loops.push_back({header, phi});
+    }
+
+    // body
+    Value *acc = IRB.getInt64(0);
+    GlobalVariable *last = nullptr;
+    for (unsigned i = j; i < cfg.globals; i += cfg.functions) {
+      for (unsigned u = 0; u < cfg.usesPerGlobal; ++u) {
+        acc = IRB.CreateAdd(acc, IRB.CreateLoad(i64Ty, gvs[i]));
+      }
+      last = gvs[i];
+    }
+    if (last) {
+      IRB.CreateStore(acc, last);
+    }
+    for (unsigned u = 1; u <= cfg.usesPerGlobal; ++u) {
+      IRB.CreateCall(fnTy, fns[(j + u) % cfg.functions]);
+    }
+
+    // close the loop nest
+    for (auto it = loops.rbegin(); it != loops.rend(); ++it) {
+      auto [header, phi] = *it;
+      auto next = IRB.CreateAdd(phi, IRB.getInt64(1));
+      auto exit = BasicBlock::Create(ctx, header->getName() + ".exit", F);
+      IRB.CreateCondBr(IRB.CreateICmpULT(next, IRB.getInt64(8)), header,
+                       exit);
+      phi->addIncoming(next, IRB.GetInsertBlock());
+      IRB.SetInsertPoint(exit);
+    }
+    IRB.CreateRetVoid();
+  }
+
+  return M;
+}
+
+int64_t countInstructions(const Module &M) {
+  int64_t count = 0;
+  for (auto &F : M) {
+    count += F.getInstructionCount();
+  }
+  return count;
+}
+
+long peakRssKb() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+template <typename Fn>
+PhaseResult measure(StringRef phase, const Module &M, Fn &&fn) {
+  auto before = countInstructions(M);
+  auto baselineRss = peakRssKb();
+  auto start = std::chrono::steady_clock::now();
+  fn();
+  auto end = std::chrono::steady_clock::now();
+  auto peakRss = peakRssKb();
+
+  return {phase.str(),
+          std::chrono::duration<double, std::milli>(end - start).count(),
+          peakRss, peakRss - baselineRss, countInstructions(M) - before};
+}
+
+/// @brief Analysis managers wired up the way `opt` does it.
+struct Analyses {
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+
+  Analyses() {
+    PassBuilder PB;
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+  }
+};
+
+ConfigResult runConfig(const BenchConfig &cfg) {
+  ConfigResult result;
+  auto &results = result.phases;
+
+  // phases one by one
+  {
+    LLVMContext ctx;
+    auto M = generateModule(ctx, cfg);
+    Analyses analyses;
+    global_value_hide::GlobalValHideManager manager(*M, &analyses.MAM);
+    results.push_back(measure("collect", *M, [&] { manager.collect(); }));
+    results.push_back(measure("encrypt", *M, [&] { manager.encrypt(); }));
+    results.push_back(measure("replace", *M, [&] { manager.replace(); }));
+  }
+
+  // whole pass on a fresh module, the only run the statistics cover
+  ResetStatistics();
+  LLVMContext ctx;
+  auto M = generateModule(ctx, cfg);
+  Analyses analyses;
+  results.push_back(measure("total", *M, [&] {
+    global_value_hide::GlobalValHideManager manager(*M, &analyses.MAM);
+    manager.run();
+  }));
+
+  for (auto &[name, value] : GetStatistics()) {
+    result.statistics.emplace_back(name.str(), value);
+  }
+
+  if (Verify && verifyModule(*M, &errs())) {
+    report_fatal_error("gvhide-compile-bench: pass produced invalid IR");
+  }
+  return result;
+}
+
+json::Value toJSON(const ConfigResult &result) {
+  json::Array phases;
+  for (auto &phase : result.phases) {
+    phases.push_back(json::Object{
+        {"phase", phase.phase},
+        {"wall_ms", phase.wallMs},
+        {"peak_rss_kb", static_cast<int64_t>(phase.peakRssKb)},
+        {"peak_rss_growth_kb", static_cast<int64_t>(phase.rssGrowthKb)},
+        {"instructions_added", phase.instructionsAdded}});
+  }
+  json::Object statistics;
+  for (auto &[name, value] : result.statistics) {
+    statistics[name] = static_cast<int64_t>(value);
+  }
+  return json::Object{{"phases", std::move(phases)},
+                      {"statistics", std::move(statistics)}};
+}
+
+/// @brief Runs a configuration in a forked child and reads its results
+/// back through a pipe.
+///
+/// `ru_maxrss` is the high-water mark of the whole process and never goes
+/// down, so measured in one process every configuration after the largest
+/// would report its peak. A child starts from the parent's current RSS
+/// instead.
+///
+/// @return The child's results as JSON, or nothing if it failed.
+std::optional<json::Value> runConfigInChild(const BenchConfig &cfg) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return std::nullopt;
+  }
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    return std::nullopt;
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    {
+      raw_fd_ostream out(fds[1], /*shouldClose=*/true);
+      out << toJSON(runConfig(cfg));
+    }
+    // skip the parent's exit handlers and buffered output
+    _exit(0);
+  }
+
+  close(fds[1]);
+  std::string text;
+  char buffer[4096];
+  ssize_t n;
+  while ((n = read(fds[0], buffer, sizeof(buffer))) > 0) {
+    text.append(buffer, n);
+  }
+  close(fds[0]);
+
+  int status;
+  if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+      WEXITSTATUS(status) != 0) {
+    return std::nullopt;
+  }
+  auto value = json::parse(text);
+  if (!value) {
+    consumeError(value.takeError());
+    return std::nullopt;
+  }
+  return std::move(*value);
+}
+
+std::vector<unsigned> valuesOr(const cl::list<unsigned> &list,
+                               unsigned fallback) {
+  if (list.empty()) {
+    return {fallback};
+  }
+  return std::vector<unsigned>(list.begin(), list.end());
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv,
+                              "global value hide compile-time benchmark\n");
+  EnableStatistics(/*DoPrintOnExit=*/false);
+
+  std::error_code EC;
+  raw_fd_ostream os(Output, EC, sys::fs::OF_Text);
+  if (EC) {
+    errs() << "gvhide-compile-bench: " << Output << ": " << EC.message()
+           << "\n";
+    return 1;
+  }
+
+  bool failed = false;
+  json::OStream J(os, 2);
+  J.object([&] {
+    J.attribute("benchmark", "gvhide-compile");
+    J.attributeArray("results", [&] {
+      for (auto globals : valuesOr(Globals, 1000)) {
+        for (auto functions : valuesOr(Functions, 100)) {
+          for (auto uses : valuesOr(UsesPerGlobal, 4)) {
+            for (auto depth : valuesOr(LoopDepth, 2)) {
+              BenchConfig cfg{globals, functions ? functions : 1, uses, depth};
+              for (unsigned run = 0; run < Repeat; ++run) {
+                auto result = runConfigInChild(cfg);
+                if (!result) {
+                  errs() << "gvhide-compile-bench: run " << run
+                         << " of globals=" << cfg.globals
+                         << " functions=" << cfg.functions
+                         << " uses-per-global=" << cfg.usesPerGlobal
+                         << " loop-depth=" << cfg.loopDepth << " failed\n";
+                  failed = true;
+                  continue;
+                }
+                auto *fields = result->getAsObject();
+                J.object([&] {
+                  J.attribute("globals", cfg.globals);
+                  J.attribute("functions", cfg.functions);
+                  J.attribute("uses_per_global", cfg.usesPerGlobal);
+                  J.attribute("loop_depth", cfg.loopDepth);
+                  J.attribute("run", run);
+                  J.attribute("phases", std::move((*fields)["phases"]));
+                  J.attribute("statistics",
+                              std::move((*fields)["statistics"]));
+                });
+              }
+            }
+          }
+        }
+      }
+    });
+  });
+  os << "\n";
+  return failed ? 1 : 0;
+}
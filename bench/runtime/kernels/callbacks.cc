@@ -0,0 +1,46 @@
+// Callbacks through a global function pointer table and virtual dispatch.
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+using Callback = long (*)(long);
+
+long add(long x) { return x + 3; }
+long sub(long x) { return x - 1; }
+long twice(long x) { return x * 2 % 1000003; }
+long half(long x) { return x / 2; }
+
+Callback callbacks[] = {add, sub, twice, half};
+
+struct Handler {
+  virtual ~Handler() = default;
+  virtual long handle(long x) const = 0;
+};
+
+struct Increment : Handler {
+  long handle(long x) const override { return x + 1; }
+};
+
+struct Scale : Handler {
+  long handle(long x) const override { return x * 3 % 1000003; }
+};
+
+Increment increment;
+Scale scale;
+const Handler *handlers[] = {&increment, &scale};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  long iterations = argc > 1 ? std::atol(argv[1]) : 50000000;
+
+  long x = 1;
+  for (long it = 0; it < iterations; ++it) {
+    x = callbacks[it & 3](x);
+    x = handlers[it & 1]->handle(x);
+  }
+
+  std::printf("%ld\n", x);
+  return 0;
+}
@@ -0,0 +1,27 @@
+// Global counters updated on every iteration.
+#include <stdio.h>
+#include <stdlib.h>
+
+unsigned long hits;
+unsigned long misses;
+unsigned long total;
+
+int main(int argc, char **argv) {
+  long iterations = argc > 1 ? atol(argv[1]) : 100000000;
+
+  unsigned x = 7;
+  for (long it = 0; it < iterations; ++it) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    if (x & 1) {
+      ++hits;
+    } else {
+      ++misses;
+    }
+    total += x & 0xff;
+  }
+
+  printf("%lu %lu %lu\n", hits, misses, total);
+  return 0;
+}
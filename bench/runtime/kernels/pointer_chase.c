@@ -0,0 +1,39 @@
+// Pointer chasing over a global index table: two global loads per step.
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NODES 65536
+
+static unsigned next_index[NODES];
+static long values[NODES];
+
+static void init(void) {
+  unsigned state = 12345;
+  for (unsigned i = 0; i < NODES; ++i) {
+    next_index[i] = i;
+    values[i] = i * 3 + 1;
+  }
+  // Sattolo shuffle: a single cycle through every node
+  for (unsigned i = NODES - 1; i > 0; --i) {
+    state = state * 1103515245u + 12345u;
+    unsigned j = state % i;
+    unsigned tmp = next_index[i];
+    next_index[i] = next_index[j];
+    next_index[j] = tmp;
+  }
+}
+
+int main(int argc, char **argv) {
+  long iterations = argc > 1 ? atol(argv[1]) : 50000000;
+  init();
+
+  unsigned i = 0;
+  long sum = 0;
+  for (long it = 0; it < iterations; ++it) {
+    i = next_index[i];
+    sum += values[i];
+  }
+
+  printf("%ld\n", sum);
+  return 0;
+}
@@ -0,0 +1,25 @@
+// Calls to small functions in a tight loop.
+#include <stdio.h>
+#include <stdlib.h>
+
+static unsigned mix(unsigned x) { return x * 2654435761u; }
+
+static unsigned rotate(unsigned x, unsigned r) {
+  return (x << r) | (x >> ((32 - r) & 31));
+}
+
+static int is_odd(unsigned x) { return x & 1; }
+
+int main(int argc, char **argv) {
+  long iterations = argc > 1 ? atol(argv[1]) : 100000000;
+
+  unsigned x = 1;
+  long odd = 0;
+  for (long it = 0; it < iterations; ++it) {
+    x = rotate(mix(x + (unsigned)it), 13);
+    odd += is_odd(x);
+  }
+
+  printf("%u %ld\n", x, odd);
+  return 0;
+}
@@ -0,0 +1,174 @@
+#!/usr/bin/env python3
+"""Runtime overhead benchmark for binaries obfuscated by gvHide.
+
+Every kernel in kernels/ is compiled once without the plugin (the baseline)
+and once per substitution with it. Each variant is run repeatedly; the
+report gives the median wall time, the slowdown over the baseline,
+instructions retired (when `perf` is usable), .text/.data growth, and whether
+the output still matches the baseline.
+
+Results are written as JSON.
+"""
+
+import argparse
+import json
+import os
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+from pathlib import Path
+
+KERNEL_DIR = Path(__file__).resolve().parent / "kernels"
+TEXT_SECTIONS = {".text"}
+DATA_SECTIONS = {".data", ".data.rel.ro", ".rodata", ".bss"}
+
+
+def compile_kernel(args, source, output, substitution):
+    compiler = args.cxx if source.suffix == ".cc" else args.cc
+    cmd = [compiler, args.opt_level, str(source), "-o", str(output)]
+    env = dict(os.environ)
+    if substitution is not None:
+        # -load makes the plugin's options known before -mllvm is parsed
+        cmd += [
+            f"-fpass-plugin={args.plugin}",
+            "-Xclang", "-load", "-Xclang", str(args.plugin),
+            "-mllvm", f"-gvhide-substitution={substitution}",
+        ]
+        env["GVHIDE_SEED"] = str(args.seed)
+    subprocess.run(cmd, check=True, env=env)
+
+
+def section_sizes(binary):
+    out = subprocess.run(["size", "-A", str(binary)], check=True,
+                         capture_output=True, text=True).stdout
+    text = data = 0
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) < 2 or not fields[1].isdigit():
+            continue
+        if fields[0] in TEXT_SECTIONS:
+            text += int(fields[1])
+        elif fields[0] in DATA_SECTIONS:
+            data += int(fields[1])
+    return text, data
+
+
+def run_once(binary, iterations):
+    start = time.perf_counter()
+    proc = subprocess.run([str(binary), str(iterations)],
+                          capture_output=True, text=True)
+    elapsed = time.perf_counter() - start
+    return elapsed, proc.returncode, proc.stdout
+
+
+def instructions_retired(binary, iterations):
+    if shutil.which("perf") is None:
+        return None
+    proc = subprocess.run(
+        ["perf", "stat", "-x,", "-e", "instructions:u", "--",
+         str(binary), str(iterations)],
+        capture_output=True, text=True)
+    for line in proc.stderr.splitlines():
+        fields = line.split(",")
+        if len(fields) > 2 and fields[2].startswith("instructions"):
+            return int(fields[0]) if fields[0].isdigit() else None
+    return None
+
+
+def measure(args, binary):
+    times = []
+    returncode, output = 0, None
+    for _ in range(args.repeat):
+        elapsed, returncode, output = run_once(binary, args.iterations)
+        if returncode != 0:
+            break
+        times.append(elapsed)
+    text, data = section_sizes(binary)
+    return {
+        "median_s": statistics.median(times) if times else None,
+        "runs_s": times,
+        "exit_code": returncode,
+        "output": output,
+        "instructions": instructions_retired(binary, args.iterations)
+        if returncode == 0 else None,
+        "text_bytes": text,
+        "data_bytes": data,
+    }
+
+
+def ratio(value, base):
+    if value is None or not base:
+        return None
+    return value / base
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--plugin", required=True, type=Path,
+                        help="path to libgvHide.so")
+    parser.add_argument("--cc", default="clang")
+    parser.add_argument("--cxx", default="clang++")
+    parser.add_argument("--opt-level", default="-O2")
+    parser.add_argument("--substitutions", default="sub1,sub2,mba",
+                        help="comma separated substitution names")
+    parser.add_argument("--kernels", default=None,
+                        help="comma separated kernel names (default: all)")
+    parser.add_argument("--iterations", type=int, default=20000000)
+    parser.add_argument("--repeat", type=int, default=5)
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("-o", "--output", default="-")
+    args = parser.parse_args()
+    args.plugin = args.plugin.resolve()
+
+    sources = sorted(p for p in KERNEL_DIR.iterdir()
+                     if p.suffix in (".c", ".cc"))
+    if args.kernels:
+        wanted = set(args.kernels.split(","))
+        sources = [p for p in sources if p.stem in wanted]
+    substitutions = [s for s in args.substitutions.split(",") if s]
+
+    results = []
+    with tempfile.TemporaryDirectory(prefix="gvhide-bench-") as tmp:
+        for source in sources:
+            variants = {}
+            for substitution in [None] + substitutions:
+                name = substitution or "baseline"
+                binary = Path(tmp) / f"{source.stem}.{name}"
+                compile_kernel(args, source, binary, substitution)
+                variants[name] = measure(args, binary)
+
+            base = variants["baseline"]
+            for name, variant in variants.items():
+                variant["slowdown"] = ratio(variant["median_s"],
+                                            base["median_s"])
+                variant["instructions_ratio"] = ratio(variant["instructions"],
+                                                      base["instructions"])
+                variant["text_growth_bytes"] = (variant["text_bytes"]
+                                                - base["text_bytes"])
+                variant["data_growth_bytes"] = (variant["data_bytes"]
+                                                - base["data_bytes"])
+                variant["output_matches"] = (variant["exit_code"] == 0 and
+                                             variant["output"] == base["output"])
+            results.append({"kernel": source.stem, "variants": variants})
+
+    report = {
+        "benchmark": "gvhide-runtime",
+        "opt_level": args.opt_level,
+        "iterations": args.iterations,
+        "repeat": args.repeat,
+        "seed": args.seed,
+        "results": results,
+    }
+    if args.output == "-":
+        json.dump(report, sys.stdout, indent=2)
+        sys.stdout.write("\n")
+    else:
+        with open(args.output, "w") as f:
+            json.dump(report, f, indent=2)
+
+
+if __name__ == "__main__":
+    main()
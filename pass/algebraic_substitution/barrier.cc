@@ -0,0 +1,189 @@
+#include "barrier.h"
+#include "pass/marker.h"
+#include <algorithm>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Analysis/VectorUtils.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/InlineAsm.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/CommandLine.h>
+#if LLVM_VERSION_MAJOR >= 17
+#include <llvm/TargetParser/Triple.h>
+#else
+#include <llvm/ADT/Triple.h>
+#endif
+
+using namespace llvm;
+
+namespace {
+
+enum class BarrierKind { None, Asm, OpaqueConst, VolatileLoad };
+
+cl::opt<BarrierKind> Barrier(
+    "gvhide-barrier", cl::init(BarrierKind::Asm),
+    cl::desc("Optimization barrier keeping substitutions from being folded"),
+    cl::values(clEnumValN(BarrierKind::None, "none", "No barrier"),
+               clEnumValN(BarrierKind::Asm, "asm",
+                          "Empty inline asm on values and constants"),
+               clEnumValN(BarrierKind::OpaqueConst, "opaque-const",
+                          "Empty inline asm on constants only"),
+               clEnumValN(BarrierKind::VolatileLoad, "volatile-load",
+                          "Volatile load of a zero byte")));
+
+/// @brief Register constraint of a vector operand on the module's target,
+/// or an empty string when vectors are pinned lane by lane.
+StringRef vectorConstraint(const Module &M) {
+  switch (Triple(M.getTargetTriple()).getArch()) {
+  case Triple::x86_64:
+    return "=x,0";
+  case Triple::aarch64:
+  case Triple::aarch64_be:
+    return "=w,0";
+  default:
+    return "";
+  }
+}
+
+/// @brief Bits of the vector registers a function can rely on: the baseline
+/// of its target (SSE2, NEON), or the AVX registers when the function is
+/// compiled for them. Wider vectors do not fit the asm constraint.
+unsigned vectorRegisterBits(const Function &F) {
+  auto features = F.getFnAttribute("target-features").getValueAsString();
+  if (Triple(F.getParent()->getTargetTriple()).getArch() == Triple::x86_64 &&
+      features.contains("+avx")) {
+    return 256;
+  }
+  return 128;
+}
+
+/// @brief Passes a value through `asm("" : "=r"(x) : "0"(x))`, which
+/// neither touches memory nor throws
+Value *createAsmBarrier(IRBuilder<> &IRB, Value *value) {
+  auto type = value->getType();
+  StringRef constraints = "=r,0";
+  if (auto vecTy = dyn_cast<FixedVectorType>(type)) {
+    auto &F = *IRB.GetInsertBlock()->getParent();
+    constraints = vectorConstraint(*F.getParent());
+    if (constraints.empty()) {
+      Value *result = PoisonValue::get(vecTy);
+      for (unsigned i = 0, e = vecTy->getNumElements(); i < e; ++i) {
+        auto lane = createAsmBarrier(IRB, IRB.CreateExtractElement(value, i));
+        result = IRB.CreateInsertElement(result, lane, i);
+      }
+      return result;
+    }
+
+    // pin a vector wider than a register one register at a time
+    unsigned laneBits = vecTy->getScalarSizeInBits();
+    unsigned regLanes = std::max(1u, vectorRegisterBits(F) / laneBits);
+    unsigned lanes = vecTy->getNumElements();
+    if (lanes > regLanes) {
+      SmallVector<Value *, 4> parts;
+      for (unsigned first = 0; first < lanes; first += regLanes) {
+        SmallVector<int, 8> mask;
+        for (unsigned i = first; i < std::min(lanes, first + regLanes); ++i) {
+          mask.push_back(i);
+        }
+        parts.push_back(
+            createAsmBarrier(IRB, IRB.CreateShuffleVector(value, mask)));
+      }
+      return concatenateVectors(IRB, parts);
+    }
+  }
+
+  auto fnTy = FunctionType::get(type, {type}, false);
+  auto asmBarrier = InlineAsm::get(fnTy, "", constraints, false);
+  auto call = IRB.CreateCall(fnTy, asmBarrier, {value}, "barrier");
+  // no memory clobber: like clang, let the optimizer move memory accesses
+  // across the barrier
+  call->setDoesNotAccessMemory();
+  call->setDoesNotThrow();
+  return call;
+}
+
+class NoBarrier : public global_value_hide::OptimizationBarrier {
+public:
+  Value *value(IRBuilder<> &IRB, Value *value) override { return value; }
+  Value *constant(IRBuilder<> &IRB, Constant *constant) override {
+    return constant;
+  }
+  unsigned valueCost() const override { return 0; }
+  unsigned constantCost() const override { return 0; }
+  StringRef name() const override { return "none"; }
+};
+
+class AsmBarrier : public global_value_hide::OptimizationBarrier {
+public:
+  Value *value(IRBuilder<> &IRB, Value *value) override {
+    return createAsmBarrier(IRB, value);
+  }
+  Value *constant(IRBuilder<> &IRB, Constant *constant) override {
+    return createAsmBarrier(IRB, constant);
+  }
+  unsigned valueCost() const override { return 0; }
+  unsigned constantCost() const override { return 1; }
+  StringRef name() const override { return "asm"; }
+};
+
+class OpaqueConstBarrier : public global_value_hide::OptimizationBarrier {
+public:
+  Value *value(IRBuilder<> &IRB, Value *value) override { return value; }
+  Value *constant(IRBuilder<> &IRB, Constant *constant) override {
+    return createAsmBarrier(IRB, constant);
+  }
+  unsigned valueCost() const override { return 0; }
+  unsigned constantCost() const override { return 1; }
+  StringRef name() const override { return "opaque-const"; }
+};
+
+class VolatileLoadBarrier : public global_value_hide::OptimizationBarrier {
+public:
+  Value *value(IRBuilder<> &IRB, Value *value) override {
+    auto &M = *IRB.GetInsertBlock()->getModule();
+    auto i8Ty = IRB.getInt8Ty();
+    auto zero = M.getOrInsertGlobal("__gvhide_barrier", i8Ty, [&] {
+      auto GV = new GlobalVariable(M, i8Ty, false, GlobalValue::PrivateLinkage,
+                                   ConstantInt::get(i8Ty, 0),
+                                   "__gvhide_barrier");
+      global_value_hide::markGenerated(*GV, "barrier");
+      return GV;
+    });
+    auto load = IRB.CreateLoad(i8Ty, zero);
+    load->setVolatile(true);
+    auto type = value->getType();
+    Value *zeroValue = IRB.CreateZExt(load, type->getScalarType());
+    if (auto vecTy = dyn_cast<FixedVectorType>(type)) {
+      zeroValue = IRB.CreateVectorSplat(vecTy->getNumElements(), zeroValue);
+    }
+    return IRB.CreateAdd(value, zeroValue);
+  }
+  Value *constant(IRBuilder<> &IRB, Constant *constant) override {
+    return value(IRB, constant);
+  }
+  unsigned valueCost() const override { return 6; }
+  unsigned constantCost() const override { return 6; }
+  StringRef name() const override { return "volatile-load"; }
+};
+
+} // namespace
+
+namespace global_value_hide {
+
+std::unique_ptr<OptimizationBarrier> createOptimizationBarrier() {
+  switch (Barrier) {
+  case BarrierKind::None:
+    return std::make_unique<NoBarrier>();
+  case BarrierKind::Asm:
+    return std::make_unique<AsmBarrier>();
+  case BarrierKind::OpaqueConst:
+    return std::make_unique<OpaqueConstBarrier>();
+  case BarrierKind::VolatileLoad:
+    return std::make_unique<VolatileLoadBarrier>();
+  }
+  return std::make_unique<AsmBarrier>();
+}
+
+} // namespace global_value_hide
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/Constant.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Value.h>
+#include <memory>
+
+namespace global_value_hide {
+
+/// @brief Interface for optimization barriers shared by all substitutions
+/// @details A barrier hides a value or a constant from the optimizer so that
+/// the arithmetic of a substitution is neither folded at IR construction nor
+/// simplified at -O2/-O3. Barriers return a value equal to their input.
+///
+/// Available barriers, selected with `-gvhide-barrier`:
+///
+/// | name            | value() cost          | constant() cost          |
+/// |-----------------|-----------------------|--------------------------|
+/// | `none`          | 0                     | 0 (expression folds)     |
+/// | `asm` (default) | 0, register pin only  | 1, `mov` of an immediate |
+/// | `opaque-const`  | 0, value left visible | 1, `mov` of an immediate |
+/// | `volatile-load` | 6, load + zext + add  | 6, load + zext + add     |
+///
+/// `asm` and `opaque-const` are register-only: they emit an empty inline asm
+/// statement with a tied register operand and never touch memory.
+/// `volatile-load` adds a volatile byte load of a private zero global; it
+/// cannot be scheduled or removed and costs a memory access per site.
+///
+/// Values and constants may also be vectors of integers, as emitted by
+/// batched decrypt sequences. `asm` then pins the vector in vector registers
+/// on x86-64 and AArch64, one register's worth at a time (128 bits, or 256
+/// for functions compiled with AVX), and each lane separately elsewhere.
+class OptimizationBarrier {
+public:
+  /// @brief Hides a computed integer value from the optimizer
+  /// @param IRB Builder positioned at the insertion point
+  /// @param value Integer or integer vector value to hide
+  /// @return A value equal to value
+  virtual llvm::Value *value(llvm::IRBuilder<> &IRB, llvm::Value *value) = 0;
+
+  /// @brief Materializes an integer constant the optimizer cannot see
+  /// @param IRB Builder positioned at the insertion point
+  /// @param constant Integer or integer vector constant to hide
+  /// @return A value equal to constant
+  virtual llvm::Value *constant(llvm::IRBuilder<> &IRB,
+                                llvm::Constant *constant) = 0;
+
+  /// @brief Estimated cost of one value() call, in TTI-like units
+  virtual unsigned valueCost() const = 0;
+
+  /// @brief Estimated cost of one constant() call, in TTI-like units
+  virtual unsigned constantCost() const = 0;
+
+  /// @brief Name used by `-gvhide-barrier`
+  virtual llvm::StringRef name() const = 0;
+
+  /// @brief Virtual destructor for proper polymorphic cleanup
+  virtual ~OptimizationBarrier() = default;
+};
+
+/// @brief Creates the barrier selected with `-gvhide-barrier`
+/// @return Owning pointer to the barrier
+std::unique_ptr<OptimizationBarrier> createOptimizationBarrier();
+
+} // namespace global_value_hide
@@ -0,0 +1,394 @@
+#include "mba.h"
+#include "utils/utils.h"
+#include <climits>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/CommandLine.h>
+#include <vector>
+#if LLVM_VERSION_MAJOR >= 17
+#include <llvm/TargetParser/Triple.h>
+#else
+#include <llvm/ADT/Triple.h>
+#endif
+
+using namespace llvm;
+
+static cl::opt<unsigned>
+    MaxCycles("gvhide-mba-max-cycles", cl::init(4),
+              cl::desc("Critical path and issue budget of an mba expression, "
+                       "in cycles of the site's target (default 4)"));
+
+static cl::opt<unsigned>
+    Rewrites("gvhide-mba-rewrites", cl::init(8),
+             cl::desc("Rewrites attempted per mba expression (default 8)"));
+
+namespace global_value_hide {
+
+namespace {
+
+/// @brief Latency and reciprocal throughput of an operation, in quarter
+/// cycles.
+struct OpTiming {
+  unsigned latency;
+  unsigned issue;
+};
+
+/// @brief Timing of the operations an mba expression is built from.
+struct TargetTiming {
+  OpTiming alu;   ///< add, sub, and, or, xor.
+  OpTiming shift; ///< shl by a constant.
+};
+
+/// @brief Timing table of the target a function is compiled for.
+///
+/// x86-64 follows recent Intel and AMD cores (four integer ALUs, two of them
+/// shifting), AArch64 follows Neoverse/Cortex-A7x cores (three integer ALUs).
+/// Other targets are assumed to issue one single-cycle operation per cycle.
+TargetTiming timingFor(const Module *M) {
+  Triple triple(M ? M->getTargetTriple() : "");
+  switch (triple.getArch()) {
+  case Triple::x86:
+  case Triple::x86_64:
+    return {{4, 1}, {4, 2}};
+  case Triple::aarch64:
+  case Triple::aarch64_be:
+    return {{4, 2}, {4, 2}};
+  default:
+    return {{4, 4}, {4, 4}};
+  }
+}
+
+/// @brief Node of a synthesized expression.
+struct Node {
+  unsigned opcode = 0;   ///< Instruction opcode, 0 for a leaf.
+  unsigned lhs = 0;      ///< Left operand.
+  unsigned rhs = 0;      ///< Right operand.
+  bool constant = false; ///< Constant leaf.
+  uint64_t value = 0;    ///< Value of a constant leaf.
+  bool pinned = false;   ///< Emitted behind the optimization barrier.
+};
+
+/// @brief Random MBA expression equal to `(x - y) - x`, kept within a
+/// latency and issue budget.
+class Synthesizer {
+private:
+  static constexpr unsigned X = 0; ///< Encrypted pointer as an integer.
+  static constexpr unsigned Y = 1; ///< Key.
+
+  std::vector<Node> nodes_;
+  unsigned root_;
+  TargetTiming timing_;
+  unsigned budget_; ///< In quarter cycles.
+
+  unsigned constant(uint64_t value) {
+    Node node;
+    node.constant = true;
+    node.value = value;
+    nodes_.push_back(node);
+    return nodes_.size() - 1;
+  }
+
+  unsigned op(unsigned opcode, unsigned lhs, unsigned rhs) {
+    Node node;
+    node.opcode = opcode;
+    node.lhs = lhs;
+    node.rhs = rhs;
+    nodes_.push_back(node);
+    return nodes_.size() - 1;
+  }
+
+  unsigned bitNot(unsigned a) {
+    return op(Instruction::Xor, a, constant(~0ULL));
+  }
+
+  unsigned twice(unsigned a) { return op(Instruction::Shl, a, constant(1)); }
+
+  /// @brief Nodes an identity can be applied to: binary operations between
+  /// two non-constant terms.
+  bool rewritable(const Node &node) const {
+    switch (node.opcode) {
+    case Instruction::Add:
+    case Instruction::Sub:
+    case Instruction::And:
+    case Instruction::Or:
+    case Instruction::Xor:
+      return !nodes_[node.lhs].constant && !nodes_[node.rhs].constant;
+    default:
+      return false;
+    }
+  }
+
+  /// @brief Collects the rewritable nodes reachable from the root.
+  void candidates(unsigned n, std::vector<bool> &seen,
+                  SmallVectorImpl<unsigned> &out) const {
+    if (seen[n] || !nodes_[n].opcode) {
+      return;
+    }
+    seen[n] = true;
+    if (rewritable(nodes_[n])) {
+      out.push_back(n);
+    }
+    candidates(nodes_[n].lhs, seen, out);
+    candidates(nodes_[n].rhs, seen, out);
+  }
+
+  /// @brief Earliest cycle the value of a node is ready, accumulating the
+  /// issue cost of every node reached.
+  unsigned ready(unsigned n, std::vector<unsigned> &memo,
+                 unsigned &issue) const {
+    auto &node = nodes_[n];
+    if (!node.opcode) {
+      return 0;
+    }
+    if (memo[n] != UINT_MAX) {
+      return memo[n];
+    }
+    auto &t = node.opcode == Instruction::Shl ? timing_.shift : timing_.alu;
+    issue += t.issue;
+    auto start = std::max(ready(node.lhs, memo, issue),
+                          ready(node.rhs, memo, issue));
+    return memo[n] = start + t.latency;
+  }
+
+  bool fits() const {
+    std::vector<unsigned> memo(nodes_.size(), UINT_MAX);
+    unsigned issue = 0;
+    auto latency = ready(root_, memo, issue);
+    return latency <= budget_ && issue <= budget_;
+  }
+
+  /// @brief Replaces node n by an equivalent expression of its operands.
+  void rewrite(unsigned n, utils::RandomEngine &rand) {
+    auto a = nodes_[n].lhs;
+    auto b = nodes_[n].rhs;
+    unsigned lhs, rhs, opcode;
+
+    switch (nodes_[n].opcode) {
+    case Instruction::Sub:
+      switch (rand.getRange(0, 4)) {
+      case 0: { // (a ^ ~b) + 1 + 2(a & ~b)
+        auto notB = bitNot(b);
+        opcode = Instruction::Add;
+        lhs = op(Instruction::Add, op(Instruction::Xor, a, notB), constant(1));
+        rhs = twice(op(Instruction::And, a, notB));
+        break;
+      }
+      case 1: // (a & ~b) - (~a & b)
+        opcode = Instruction::Sub;
+        lhs = op(Instruction::And, a, bitNot(b));
+        rhs = op(Instruction::And, bitNot(a), b);
+        break;
+      case 2: // (a ^ b) - 2(~a & b)
+        opcode = Instruction::Sub;
+        lhs = op(Instruction::Xor, a, b);
+        rhs = twice(op(Instruction::And, bitNot(a), b));
+        break;
+      case 3: // 2(a & ~b) - (a ^ b)
+        opcode = Instruction::Sub;
+        lhs = twice(op(Instruction::And, a, bitNot(b)));
+        rhs = op(Instruction::Xor, a, b);
+        break;
+      default: // (a + ~b) + 1
+        opcode = Instruction::Add;
+        lhs = op(Instruction::Add, a, bitNot(b));
+        rhs = constant(1);
+        break;
+      }
+      break;
+    case Instruction::Add:
+      switch (rand.getRange(0, 2)) {
+      case 0: // (a ^ b) + 2(a & b)
+        opcode = Instruction::Add;
+        lhs = op(Instruction::Xor, a, b);
+        rhs = twice(op(Instruction::And, a, b));
+        break;
+      case 1: // (a | b) + (a & b)
+        opcode = Instruction::Add;
+        lhs = op(Instruction::Or, a, b);
+        rhs = op(Instruction::And, a, b);
+        break;
+      default: // 2(a | b) - (a ^ b)
+        opcode = Instruction::Sub;
+        lhs = twice(op(Instruction::Or, a, b));
+        rhs = op(Instruction::Xor, a, b);
+        break;
+      }
+      break;
+    case Instruction::Xor:
+      opcode = Instruction::Sub;
+      if (rand.getRange(0, 1)) { // (a | b) - (a & b)
+        lhs = op(Instruction::Or, a, b);
+        rhs = op(Instruction::And, a, b);
+      } else { // (a + b) - 2(a & b)
+        lhs = op(Instruction::Add, a, b);
+        rhs = twice(op(Instruction::And, a, b));
+      }
+      break;
+    case Instruction::And:
+      opcode = Instruction::Sub;
+      if (rand.getRange(0, 1)) { // (a + b) - (a | b)
+        lhs = op(Instruction::Add, a, b);
+        rhs = op(Instruction::Or, a, b);
+      } else { // (a | b) - (a ^ b)
+        lhs = op(Instruction::Or, a, b);
+        rhs = op(Instruction::Xor, a, b);
+      }
+      break;
+    default: // Or
+      if (rand.getRange(0, 1)) { // (a + b) - (a & b)
+        opcode = Instruction::Sub;
+        lhs = op(Instruction::Add, a, b);
+        rhs = op(Instruction::And, a, b);
+      } else { // (a ^ b) + (a & b)
+        opcode = Instruction::Add;
+        lhs = op(Instruction::Xor, a, b);
+        rhs = op(Instruction::And, a, b);
+      }
+      break;
+    }
+
+    // pin one side so InstCombine cannot fold the identity back
+    nodes_[lhs].pinned = true;
+    auto &node = nodes_[n];
+    node.opcode = opcode;
+    node.lhs = lhs;
+    node.rhs = rhs;
+  }
+
+  Value *emit(IRBuilder<> &IRB, OptimizationBarrier &barrier, Type *type,
+              unsigned n, std::vector<Value *> &values) const {
+    if (values[n]) {
+      return values[n];
+    }
+    auto &node = nodes_[n];
+    Value *value;
+    if (node.constant) {
+      value = ConstantInt::get(type, node.value);
+    } else {
+      auto lhs = emit(IRB, barrier, type, node.lhs, values);
+      auto rhs = emit(IRB, barrier, type, node.rhs, values);
+      value = IRB.CreateBinOp(static_cast<Instruction::BinaryOps>(node.opcode),
+                              lhs, rhs);
+      if (node.pinned) {
+        value = barrier.value(IRB, value);
+      }
+    }
+    return values[n] = value;
+  }
+
+public:
+  Synthesizer(const TargetTiming &timing, unsigned budget)
+      : timing_(timing), budget_(budget) {
+    nodes_.resize(2);
+    auto diff = op(Instruction::Sub, X, Y);
+    nodes_[diff].pinned = true;
+    root_ = op(Instruction::Sub, diff, X);
+  }
+
+  /// @brief Applies random rewrites, undoing those that exceed the budget.
+  void synthesize(utils::RandomEngine &rand, unsigned attempts) {
+    for (unsigned i = 0; i < attempts; ++i) {
+      std::vector<bool> seen(nodes_.size());
+      SmallVector<unsigned, 16> nodes;
+      candidates(root_, seen, nodes);
+      auto n = rand.getRandomRef(nodes);
+
+      auto saved = nodes_[n];
+      auto size = nodes_.size();
+      rewrite(n, rand);
+      if (!fits()) {
+        nodes_[n] = saved;
+        nodes_.resize(size);
+      }
+    }
+  }
+
+  /// @brief Lists the operations emitted for the expression.
+  /// @return Number of pinned operations.
+  unsigned shape(SmallVectorImpl<unsigned> &ops) const {
+    std::vector<bool> seen(nodes_.size());
+    unsigned pinned = 0;
+    SmallVector<unsigned, 32> worklist{root_};
+    while (!worklist.empty()) {
+      auto n = worklist.pop_back_val();
+      auto &node = nodes_[n];
+      if (seen[n] || !node.opcode) {
+        continue;
+      }
+      seen[n] = true;
+      ops.push_back(node.opcode);
+      pinned += node.pinned;
+      worklist.push_back(node.lhs);
+      worklist.push_back(node.rhs);
+    }
+    return pinned;
+  }
+
+  /// @brief Emits the expression.
+  /// @return Value equal to `-y`.
+  Value *emit(IRBuilder<> &IRB, OptimizationBarrier &barrier, Value *x,
+              Value *y) const {
+    std::vector<Value *> values(nodes_.size());
+    values[X] = x;
+    values[Y] = y;
+    return emit(IRB, barrier, x->getType(), root_, values);
+  }
+};
+
+} // namespace
+
+/// @brief Synthesizes a random expression of the key within the target's
+/// budget and applies it to the encrypted pointer
+/// @details The seed expression `(x - key) - x` always has a rewritable node,
+/// so every attempt draws a candidate; rewrites over budget are undone, and
+/// the seed is emitted as is when even the first rewrite does not fit.
+///
+/// @param IRB Active IR builder for instruction insertion
+/// @param encrypted Pointer loaded from the table, or vector of pointers
+/// @param key Constant key used in transformation, one per lane for vectors
+/// @param ctx LLVM context for type creation
+/// @param rand Engine for the shape of this site's expression
+/// @return GEP of the encrypted pointer by the synthesized offset
+Value *Mba::substitution(llvm::IRBuilder<> &IRB, llvm::Value *encrypted,
+                         llvm::Constant *key, llvm::LLVMContext &ctx,
+                         utils::RandomEngine &rand) {
+  auto M = IRB.GetInsertBlock()->getModule();
+  Synthesizer synth(timingFor(M), MaxCycles * 4);
+  synth.synthesize(rand, Rewrites);
+
+  // a vector of pointers is decrypted lane by lane with the same expression
+  Type *intTy = Type::getInt64Ty(ctx);
+  if (auto vecTy = dyn_cast<FixedVectorType>(encrypted->getType())) {
+    intTy = FixedVectorType::get(intTy, vecTy->getNumElements());
+  }
+  Value *base = IRB.CreatePtrToInt(encrypted, intTy);
+  Value *keyVal = barrier().constant(IRB, key);
+  Value *offset = synth.emit(IRB, barrier(), base, keyVal);
+
+  return IRB.CreateGEP(Type::getInt8Ty(ctx), encrypted, offset, "mba_dec");
+}
+
+ArrayRef<unsigned> Mba::opcodes() const {
+  static const unsigned ops[] = {
+      Instruction::PtrToInt, Instruction::Sub, Instruction::Xor,
+      Instruction::Xor,      Instruction::Add, Instruction::And,
+      Instruction::Shl,      Instruction::Add, Instruction::GetElementPtr};
+  return ops;
+}
+
+unsigned Mba::barrierValues() const { return 1 + Rewrites; }
+
+unsigned Mba::siteShape(const Module &M, utils::RandomEngine rand,
+                        SmallVectorImpl<unsigned> &ops) const {
+  // same draws as substitution()
+  Synthesizer synth(timingFor(&M), MaxCycles * 4);
+  synth.synthesize(rand, Rewrites);
+
+  ops.push_back(Instruction::PtrToInt);
+  auto pinned = synth.shape(ops);
+  ops.push_back(Instruction::GetElementPtr);
+  return pinned;
+}
+
+} // namespace global_value_hide
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "pass/algebraic_substitution/substitution.h"
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/LLVMContext.h>
+
+namespace global_value_hide {
+
+/// @brief Substitution synthesizing a fresh mixed boolean-arithmetic
+/// expression per decrypt site
+/// @details Starts from `((x - key) - x)` with `x` the encrypted pointer and
+/// rewrites random nodes with MBA identities (`a - b = (a ^ ~b) + 2(a & ~b) +
+/// 1`, `a + b = (a | b) + (a & b)`, ...). A rewrite is kept only while the
+/// expression still fits the latency and throughput budget of the site's
+/// target, so every site gets a different shape at a bounded cost. The result
+/// is `gep i8, encrypted, -key`, computed without leaving the pointer's
+/// provenance. Vectors of encrypted pointers are decrypted with one
+/// expression over all lanes.
+class Mba : public AlgebraicSubstitutionBase<Mba> {
+public:
+  /// @brief Synthesizes and emits the expression of one site
+  /// @inheritDoc AlgebraicSubstitutionInterface::substitution
+  llvm::Value *substitution(llvm::IRBuilder<> &IRB, llvm::Value *encrypted,
+                            llvm::Constant *key, llvm::LLVMContext &ctx,
+                            utils::RandomEngine &rand) override;
+
+  llvm::StringRef name() const override { return "mba"; }
+
+  /// @brief Opcodes of a typical expression at the default budget
+  /// @details Only a reference: the cost model prices every site with the
+  /// expression siteShape() synthesizes for it.
+  llvm::ArrayRef<unsigned> opcodes() const override;
+
+  /// @brief Upper bound: the seed expression and every accepted rewrite pin
+  /// one subterm
+  unsigned barrierValues() const override;
+
+  bool variesPerSite() const override { return true; }
+
+  /// @brief Synthesizes the site's expression without emitting it
+  /// @inheritDoc AlgebraicSubstitutionInterface::siteShape
+  unsigned siteShape(const llvm::Module &M, utils::RandomEngine rand,
+                     llvm::SmallVectorImpl<unsigned> &ops) const override;
+
+  unsigned barrierConstants() const override { return 1; }
+
+  bool vectorizable() const override { return true; }
+};
+
+} // namespace global_value_hide
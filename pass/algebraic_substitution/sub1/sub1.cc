@@ -1,5 +1,7 @@
 #include "sub1.h"
 #include "utils/utils.h"
+#include <cstdint>
+#include <iterator>
 
 using namespace llvm;
 
@@ -8,59 +10,61 @@ namespace global_value_hide {
 /// @brief Implements substitution with dynamic obfuscation patterns
 /// @details Constructs an obscured pointer calculation using:
 /// 1. Random constants generation
-/// 2. Volatile memory operations
+/// 2. Optimization barriers on the key and the masked key
 /// 3. Instruction sequence randomization
-/// 4. Metadata tagging for identification
+/// 4. Metadata tagging for identification, unless value names are discarded
+///
+/// The key is masked before the barrier and unmasked after it, so every
+/// constant cancels and the GEP subtracts exactly the key.
 ///
 /// @param IRB Active IR builder for instruction insertion
 /// @param encrypted Pointer value to obfuscate
 /// @param key Constant key used in transformation
 /// @param ctx LLVM context for type creation
+/// @param rand Engine for the random constants of this site
 /// @return Obfuscated GEP instruction with anti-analysis properties
 Value *Sub1::substitution(llvm::IRBuilder<> &IRB, llvm::Value *encrypted,
-                          llvm::Constant *key, llvm::LLVMContext &ctx) {
-  // Random constants pool (volatile to prevent constant propagation)
-  static auto randEngine = utils::RandomEngine();
-  volatile uint32_t randA = randEngine.getUint32();
-  volatile uint32_t randB = randEngine.getUint32();
-  volatile uint32_t randC = randEngine.getUint32();
-  volatile uint32_t randD = randEngine.getUint32();
+                          llvm::Constant *key, llvm::LLVMContext &ctx,
+                          utils::RandomEngine &rand) {
+  uint64_t randA = rand.getUint32();
+  uint64_t randB = rand.getUint32();
+  uint64_t randC = rand.getUint32();
+  uint64_t rounds[3];
+  for (auto &round : rounds) {
+    round = rand.getUint32();
+  }
 
   /* Core transformation pipeline */
-  // Convert pointers to integer types for arithmetic operations
-  Value *base = IRB.CreatePtrToInt(encrypted, Type::getInt64Ty(ctx));
-  Value *keyVal = IRB.CreatePtrToInt(key, Type::getInt64Ty(ctx));
-
-  // Construct complex calculation using random constants
-  // base + (randC - (key + randA) ^ randB) + randD
-  Value *calc1 = IRB.CreateAdd(keyVal, IRB.getInt64(randA));
-  calc1 = IRB.CreateXor(calc1, IRB.getInt64(randB));
-  Value *calc2 = IRB.CreateSub(IRB.getInt64(randC), calc1);
-  calc2 = IRB.CreateAnd(calc2, IRB.getInt64(randD));
+  // Materialize the key behind the barrier so the arithmetic below survives
+  Value *keyVal = barrier().constant(IRB, key);
 
-  Value *dynamicOffset = IRB.CreateAdd(base, calc2);
-  dynamicOffset = IRB.CreateTrunc(dynamicOffset, Type::getInt32Ty(ctx));
+  // Mask the key: ((key + randA) ^ randB), then the random rounds
+  Value *masked = IRB.CreateAdd(keyVal, IRB.getInt64(randA));
+  masked = IRB.CreateXor(masked, IRB.getInt64(randB));
+  for (auto round : rounds) {
+    masked = IRB.CreateXor(masked, IRB.getInt64(round));
+    masked = IRB.CreateAdd(masked, IRB.getInt64(1));
+  }
 
   //=== Anti-optimization Measures ===//
-  // Insert volatile load from random address to create false dependency
-  Value *dummyPtr =
-      IRB.CreateIntToPtr(base, PointerType::get(Type::getInt8Ty(ctx), 0));
-  LoadInst *volatileLoad = IRB.CreateLoad(Type::getInt8Ty(ctx), dummyPtr);
-  volatileLoad->setVolatile(true);
-  dynamicOffset = IRB.CreateAdd(
-      dynamicOffset, IRB.CreateZExt(volatileLoad, Type::getInt32Ty(ctx)));
+  // Pin the masked key so the unmasking below is not folded into it
+  Value *offset = barrier().value(IRB, masked);
 
-  // Add unpredictable instruction sequence
-  for (int i = 0; i < 3; ++i) {
-    dynamicOffset =
-        IRB.CreateXor(dynamicOffset, IRB.getInt32(randEngine.getUint32()));
-    dynamicOffset = IRB.CreateAdd(dynamicOffset, IRB.getInt32(1));
+  // Undo the rounds, then (randC - (key + randA)) + (randA - randC) == -key
+  for (auto it = std::rbegin(rounds); it != std::rend(rounds); ++it) {
+    offset = IRB.CreateSub(offset, IRB.getInt64(1));
+    offset = IRB.CreateXor(offset, IRB.getInt64(*it));
   }
+  offset = IRB.CreateXor(offset, IRB.getInt64(randB));
+  offset = IRB.CreateSub(IRB.getInt64(randC), offset);
+  offset = IRB.CreateAdd(offset, IRB.getInt64(randA - randC));
 
-  // Create final obfuscated GEP with metadata
-  Value *gvAddr =
-      IRB.CreateGEP(encrypted->getType(), encrypted, dynamicOffset, "obf_gep");
-  if (Instruction *gepInst = dyn_cast<Instruction>(gvAddr)) {
+  // Create final obfuscated GEP with metadata, unless tags are off for speed
+  // (-gvhide-fast)
+  Value *gvAddr = IRB.CreateGEP(Type::getInt8Ty(ctx), encrypted, offset,
+                                "obf_gep");
+  Instruction *gepInst = dyn_cast<Instruction>(gvAddr);
+  if (gepInst && siteMetadata()) {
     MDNode *meta = MDNode::get(ctx, {MDString::get(ctx, "obfuscated")});
     gepInst->setMetadata("obf.md", meta);
   }
@@ -68,4 +72,14 @@ Value *Sub1::substitution(llvm::IRBuilder<> &IRB, llvm::Value *encrypted,
   return gvAddr;
 }
 
+ArrayRef<unsigned> Sub1::opcodes() const {
+  static const unsigned ops[] = {
+      Instruction::Add, Instruction::Xor, Instruction::Xor, Instruction::Add,
+      Instruction::Xor, Instruction::Add, Instruction::Xor, Instruction::Add,
+      Instruction::Sub, Instruction::Xor, Instruction::Sub, Instruction::Xor,
+      Instruction::Sub, Instruction::Xor, Instruction::Xor, Instruction::Sub,
+      Instruction::Add, Instruction::GetElementPtr};
+  return ops;
+}
+
 } // namespace global_value_hide
\ No newline at end of file
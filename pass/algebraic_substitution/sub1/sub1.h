@@ -7,18 +7,27 @@
 namespace global_value_hide {
 
 /// @brief Concrete substitution implementing additive-mask transformation
-/// @details Implements the formula:
-/// `constA - ((-(key + constA)) + ((key + constA) ^ constB) + constC) ^ constD)
-/// Provides anti-optimization measures through volatile operations and random
-/// instruction sequencing.
+/// @details Masks the key as `(key + constA) ^ constB` followed by three
+/// random `xor`/`add` rounds, pins it, and unmasks it into the byte offset
+/// `(constC - (key + constA)) + (constA - constC)`, i.e. `-key`.
+/// Provides anti-optimization measures through the shared optimization barrier
+/// and random instruction sequencing.
 class Sub1 : public AlgebraicSubstitutionBase<Sub1> {
 public:
   /// @brief Applies algebraic substitution with anti-optimization measures
   /// @inheritDoc AlgebraicSubstitutionInterface::substitution
   /// @note Generates non-deterministic code patterns to hinder static analysis
   llvm::Value *substitution(llvm::IRBuilder<> &IRB, llvm::Value *encrypted,
-                            llvm::Constant *key,
-                            llvm::LLVMContext &ctx) override;
+                            llvm::Constant *key, llvm::LLVMContext &ctx,
+                            utils::RandomEngine &rand) override;
+
+  llvm::StringRef name() const override { return "sub1"; }
+
+  llvm::ArrayRef<unsigned> opcodes() const override;
+
+  unsigned barrierValues() const override { return 1; }
+
+  unsigned barrierConstants() const override { return 1; }
 };
 
 } // namespace global_value_hide
\ No newline at end of file
@@ -7,22 +7,31 @@ using namespace llvm;
 namespace global_value_hide {
 
 Value *Sub2::substitution(llvm::IRBuilder<> &IRB, llvm::Value *encrypted,
-                          llvm::Constant *key, llvm::LLVMContext &ctx) {
-  static utils::RandomEngine randomEngine;
-  volatile uint32_t randA = randomEngine.getUint32();
-  volatile uint32_t randB = randomEngine.getUint32();
-  volatile uint32_t randC = randomEngine.getRange(UINT16_MAX, randB - 1);
-  auto randD = randA + randB - randC;
+                          llvm::Constant *key, llvm::LLVMContext &ctx,
+                          utils::RandomEngine &rand) {
+  volatile uint32_t randA = rand.getUint32();
+  volatile uint32_t randB = rand.getUint32();
+  volatile uint32_t randC = rand.getRange(UINT16_MAX, randB - 1);
+  // the constants cancel out: A - C + B + D == 0
+  uint64_t randD = uint64_t(randC) - randA - randB;
 
-  Value *keyVal = IRB.CreatePtrToInt(key, Type::getInt64Ty(ctx));
+  // Materialize the negated key behind the barrier so the additions survive
+  Value *keyVal = barrier().constant(IRB, ConstantExpr::getNeg(key));
   auto key_fine = IRB.CreateAdd(keyVal, IRB.getInt64(randA));
   key_fine = IRB.CreateSub(key_fine, IRB.getInt64(randC));
   key_fine = IRB.CreateAdd(key_fine, IRB.getInt64(randB));
   key_fine = IRB.CreateAdd(key_fine, IRB.getInt64(randD));
 
   auto gvAddr =
-      IRB.CreateGEP(encrypted->getType(), encrypted, key_fine, "sub2_gef");
+      IRB.CreateGEP(Type::getInt8Ty(ctx), encrypted, key_fine, "sub2_gef");
   return gvAddr;
 }
 
+ArrayRef<unsigned> Sub2::opcodes() const {
+  static const unsigned ops[] = {Instruction::Add, Instruction::Sub,
+                                 Instruction::Add, Instruction::Add,
+                                 Instruction::GetElementPtr};
+  return ops;
+}
+
 } // namespace global_value_hide
\ No newline at end of file
@@ -7,8 +7,16 @@ namespace global_value_hide {
 class Sub2 : public AlgebraicSubstitutionBase<Sub2> {
 public:
   llvm::Value *substitution(llvm::IRBuilder<> &IRB, llvm::Value *encrypted,
-                            llvm::Constant *key,
-                            llvm::LLVMContext &ctx) override;                          
+                            llvm::Constant *key, llvm::LLVMContext &ctx,
+                            utils::RandomEngine &rand) override;
+
+  llvm::StringRef name() const override { return "sub2"; }
+
+  llvm::ArrayRef<unsigned> opcodes() const override;
+
+  bool light() const override { return true; }
+
+  unsigned barrierConstants() const override { return 1; }
 };
 
 } // namespace global_value_hide
\ No newline at end of file
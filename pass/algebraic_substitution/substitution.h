@@ -1,8 +1,14 @@
 #pragma once
 
+#include "barrier.h"
+#include "utils/utils.h"
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/SmallVector.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
 #include <llvm/IR/Value.h>
+#include <cassert>
 
 namespace global_value_hide {
 
@@ -10,16 +16,88 @@ namespace global_value_hide {
 /// @details Defines the common interface for all algebraic substitution
 /// implementations used in global value hiding transformations.
 class AlgebraicSubstitutionInterface {
+private:
+  OptimizationBarrier *barrier_ = nullptr; ///< Shared anti-folding barrier
+  bool siteMetadata_ = true; ///< Whether sites may be tagged with metadata
+
+protected:
+  /// @brief Barrier to wrap values and constants that must not be folded
+  OptimizationBarrier &barrier() const {
+    assert(barrier_ && "substitution used before setBarrier()");
+    return *barrier_;
+  }
+
+  /// @brief Whether emitted instructions may carry per-site metadata
+  bool siteMetadata() const { return siteMetadata_; }
+
 public:
+  /// @brief Sets the optimization barrier used by the substitution
+  /// @param barrier Barrier owned by the substitution registry
+  void setBarrier(OptimizationBarrier &barrier) { barrier_ = &barrier; }
+
+  /// @brief Barrier the substitution currently uses
+  const OptimizationBarrier &getBarrier() const { return barrier(); }
+
+  /// @brief Enables or disables per-site metadata, off with `-gvhide-fast`
+  void setSiteMetadata(bool enabled) { siteMetadata_ = enabled; }
+
   /// @brief Performs algebraic substitution on encrypted value
   /// @param IRB LLVM IR builder for instruction insertion
   /// @param encrypted The encrypted value to transform
   /// @param key Constant key used in substitution
   /// @param ctx LLVM context for type creation
+  /// @param rand Engine for the random constants of this site
   /// @return Transformed LLVM IR value representing substituted result
   virtual llvm::Value *substitution(llvm::IRBuilder<> &IRB,
                                     llvm::Value *encrypted, llvm::Constant *key,
-                                    llvm::LLVMContext &ctx) = 0;
+                                    llvm::LLVMContext &ctx,
+                                    utils::RandomEngine &rand) = 0;
+
+  /// @brief Name of the substitution, used to select it on the command line
+  /// @return Short lowercase identifier, e.g. "sub1"
+  virtual llvm::StringRef name() const = 0;
+
+  /// @brief Opcodes of the instructions emitted per decrypt site
+  /// @details Operations on constants that fold away and the instructions of
+  /// the optimization barrier are not listed. Used by the cost model to price
+  /// the substitution for the target.
+  /// @return One entry per emitted instruction
+  virtual llvm::ArrayRef<unsigned> opcodes() const = 0;
+
+  /// @brief Whether substitution() also decrypts several addresses at once
+  /// @details A vectorizable substitution accepts a vector of encrypted
+  /// pointers with a vector key of as many lanes and returns the vector of
+  /// decrypted addresses. Decrypt batching only merges sites that use such a
+  /// substitution.
+  virtual bool vectorizable() const { return false; }
+
+  /// @brief Whether the substitution is cheap enough for `light` functions
+  /// @details Functions annotated `gvhide=light` only use light
+  /// substitutions.
+  virtual bool light() const { return false; }
+
+  /// @brief Number of OptimizationBarrier::value() calls per decrypt site
+  virtual unsigned barrierValues() const { return 0; }
+
+  /// @brief Whether the emitted sequence depends on the site's engine
+  /// @details The cost model then prices every site with siteShape()
+  /// instead of once per function with opcodes().
+  virtual bool variesPerSite() const { return false; }
+
+  /// @brief Opcodes and barrier values of the sequence substitution() emits
+  /// with a given engine
+  /// @param M Module the sequence is emitted in
+  /// @param rand Copy of the engine substitution() receives
+  /// @param ops Receives one entry per emitted instruction
+  /// @return Number of OptimizationBarrier::value() calls
+  virtual unsigned siteShape(const llvm::Module &M, utils::RandomEngine rand,
+                             llvm::SmallVectorImpl<unsigned> &ops) const {
+    ops.append(opcodes().begin(), opcodes().end());
+    return barrierValues();
+  }
+
+  /// @brief Number of OptimizationBarrier::constant() calls per decrypt site
+  virtual unsigned barrierConstants() const { return 0; }
 
   /// @brief Virtual destructor for proper polymorphic cleanup
   virtual ~AlgebraicSubstitutionInterface() = default;
@@ -37,9 +115,9 @@ public:
   /// @inheritDoc AlgebraicSubstitutionInterface::substitution
   /// @note Uses static_cast to forward call to derived class implementation
   llvm::Value *substitution(llvm::IRBuilder<> &IRB, llvm::Value *encrypted,
-                            llvm::Constant *key,
-                            llvm::LLVMContext &ctx) override {
-    return static_cast<T *>(this)->substitution(IRB, encrypted, key, ctx);
+                            llvm::Constant *key, llvm::LLVMContext &ctx,
+                            utils::RandomEngine &rand) override {
+    return static_cast<T *>(this)->substitution(IRB, encrypted, key, ctx, rand);
   }
 };
 
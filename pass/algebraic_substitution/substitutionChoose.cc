@@ -1,9 +1,20 @@
 #include "substitutionChoose.h"
+#include "mba/mba.h"
 #include "sub1/sub1.h"
 #include "sub2/sub2.h"
 #include "substitution.h"
 #include "utils.h"
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/raw_ostream.h>
+#include <cassert>
+#include <cstdlib>
 #include <memory>
+#include <optional>
+
+static llvm::cl::opt<std::string> ForceSubstitution(
+    "gvhide-substitution",
+    llvm::cl::desc("Use the named substitution (e.g. sub1, sub2, mba) instead of "
+                   "a random one"));
 
 namespace global_value_hide {
 
@@ -12,19 +23,84 @@ AlgSubList AlgebraicSubstitutionChoose::collectorSubstitution() {
   AlgSubList subs;
   subs.emplace_back(std::make_unique<Sub1>());
   subs.emplace_back(std::make_unique<Sub2>());
+  subs.emplace_back(std::make_unique<Mba>());
 
   return subs;
 }
 
 AlgebraicSubstitutionChoose::AlgebraicSubstitutionChoose() {
   subs_ = collectorSubstitution();
+  barrier_ = createOptimizationBarrier();
+  for (auto &sub : subs_) {
+    sub->setBarrier(*barrier_);
+  }
+}
+
+/// @brief Returns the strategy forced by -gvhide-substitution, if any
+static AlgebraicSubstitutionInterface *forcedSubstitution(AlgSubList &subs) {
+  if (ForceSubstitution.empty()) {
+    return nullptr;
+  }
+  for (auto &sub : subs) {
+    if (sub->name() == ForceSubstitution) {
+      return sub.get();
+    }
+  }
+  // a typo on the command line, not a crash: no stack dump
+  llvm::errs() << "error: gvhide: unknown substitution '" << ForceSubstitution
+               << "'\n";
+  std::exit(1);
 }
 
-AlgebraicSubstitutionInterface &AlgebraicSubstitutionChoose::choose() {
+AlgebraicSubstitutionInterface &
+AlgebraicSubstitutionChoose::choose(utils::RandomEngine &rand, bool light) {
+  if (auto *forced = forcedSubstitution(subs_)) {
+    return *forced;
+  }
+
+  if (light) {
+    std::vector<AlgebraicSubstitutionInterface *> lightSubs;
+    for (auto &sub : subs_) {
+      if (sub->light()) {
+        lightSubs.push_back(sub.get());
+      }
+    }
+    assert(!lightSubs.empty() && "no light substitution registered");
+    return *rand.getRandomRef(lightSubs);
+  }
+
   // choose random substitution
-  static utils::RandomEngine rand;
   auto &ref = rand.getRandomRef(subs_);
   return *ref;
 }
 
+AlgebraicSubstitutionInterface &
+AlgebraicSubstitutionChoose::choose(utils::RandomEngine &rand,
+                                    llvm::ArrayRef<unsigned> costs,
+                                    uint64_t maxCost, bool light) {
+  if (auto *forced = forcedSubstitution(subs_)) {
+    return *forced;
+  }
+
+  std::vector<AlgebraicSubstitutionInterface *> admissible;
+  std::optional<size_t> cheapest;
+  for (size_t i = 0; i < subs_.size(); ++i) {
+    if (light && !subs_[i]->light()) {
+      continue;
+    }
+    if (costs[i] <= maxCost) {
+      admissible.push_back(subs_[i].get());
+    }
+    if (!cheapest || costs[i] < costs[*cheapest]) {
+      cheapest = i;
+    }
+  }
+
+  assert(cheapest && "no light substitution registered");
+  if (admissible.empty()) {
+    return *subs_[*cheapest];
+  }
+  return *rand.getRandomRef(admissible);
+}
+
 } // namespace global_value_hide
\ No newline at end of file
@@ -1,4 +1,8 @@
+#pragma once
+
 #include "substitution.h"
+#include <cstdint>
+#include <llvm/ADT/ArrayRef.h>
 #include <vector>
 
 namespace global_value_hide {
@@ -12,6 +16,8 @@ using AlgSubList = std::vector<std::unique_ptr<AlgebraicSubstitutionInterface>>;
 class AlgebraicSubstitutionChoose {
 private:
   AlgSubList subs_; ///< List of registered substitution strategies
+  std::unique_ptr<OptimizationBarrier>
+      barrier_; ///< Barrier shared by every strategy
 
   /// @brief Factory method that collects all available substitution
   /// implementations
@@ -24,10 +30,30 @@ public:
   AlgebraicSubstitutionChoose();
 
   /// @brief Randomly selects an algebraic substitution strategy
+  /// @details `-gvhide-substitution=<name>` forces a specific strategy.
+  /// @param rand Engine driving the selection
+  /// @param light Only select among light strategies
+  /// @return AlgebraicSubstitutionInterface& Reference to selected strategy
+  /// @note The returned reference remains valid for the lifetime of the
+  ///       chooser object.
+  AlgebraicSubstitutionInterface &choose(utils::RandomEngine &rand,
+                                         bool light = false);
+
+  /// @brief Randomly selects a strategy that fits a cost limit
+  /// @details Picks uniformly among the strategies whose cost is at most
+  /// maxCost, or the cheapest one if none fits. `-gvhide-substitution` still
+  /// takes precedence.
+  /// @param rand Engine driving the selection
+  /// @param costs Cost of each strategy, in the order of substitutions()
+  /// @param maxCost Highest admissible cost
+  /// @param light Only select among light strategies
   /// @return AlgebraicSubstitutionInterface& Reference to selected strategy
-  /// @note Uses thread-local random number generator internally. The returned
-  ///       reference remains valid for the lifetime of the chooser object.
-  AlgebraicSubstitutionInterface &choose();
+  AlgebraicSubstitutionInterface &choose(utils::RandomEngine &rand,
+                                         llvm::ArrayRef<unsigned> costs,
+                                         uint64_t maxCost, bool light = false);
+
+  /// @brief Registered strategies, in registration order
+  const AlgSubList &substitutions() const { return subs_; }
 };
 
 } // namespace global_value_hide
\ No newline at end of file
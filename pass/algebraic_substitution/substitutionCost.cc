@@ -0,0 +1,100 @@
+#include "substitutionCost.h"
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Instruction.h>
+#include <llvm/IR/Type.h>
+#include <llvm/Support/Alignment.h>
+
+using namespace llvm;
+
+namespace global_value_hide {
+
+/// @brief Cost of a single opcode, or the fallback when TTI has no answer
+static unsigned opcodeCost(unsigned opcode, const TargetTransformInfo *TTI,
+                           LLVMContext &ctx) {
+  unsigned fallback = opcode == Instruction::Load ? 4 : 1;
+  if (!TTI) {
+    return fallback;
+  }
+
+  auto costKind = TargetTransformInfo::TCK_SizeAndLatency;
+  auto i32Ty = Type::getInt32Ty(ctx);
+  auto i64Ty = Type::getInt64Ty(ctx);
+  auto ptrTy = PointerType::get(Type::getInt8Ty(ctx), 0);
+
+  InstructionCost cost;
+  switch (opcode) {
+  case Instruction::Load:
+    cost = TTI->getMemoryOpCost(opcode, i64Ty, Align(8), 0, costKind);
+    break;
+  case Instruction::PtrToInt:
+    cost = TTI->getCastInstrCost(opcode, i64Ty, ptrTy,
+                                 TargetTransformInfo::CastContextHint::None,
+                                 costKind);
+    break;
+  case Instruction::IntToPtr:
+    cost = TTI->getCastInstrCost(opcode, ptrTy, i64Ty,
+                                 TargetTransformInfo::CastContextHint::None,
+                                 costKind);
+    break;
+  case Instruction::Trunc:
+    cost = TTI->getCastInstrCost(opcode, i32Ty, i64Ty,
+                                 TargetTransformInfo::CastContextHint::None,
+                                 costKind);
+    break;
+  case Instruction::ZExt:
+  case Instruction::SExt:
+    cost = TTI->getCastInstrCost(opcode, i64Ty, i32Ty,
+                                 TargetTransformInfo::CastContextHint::None,
+                                 costKind);
+    break;
+  case Instruction::GetElementPtr:
+    // a byte offset GEP lowers to an add
+    cost = TTI->getArithmeticInstrCost(Instruction::Add, i64Ty, costKind);
+    break;
+  default:
+    if (Instruction::isBinaryOp(opcode)) {
+      cost = TTI->getArithmeticInstrCost(opcode, i64Ty, costKind);
+    } else {
+      return fallback;
+    }
+    break;
+  }
+
+  if (!cost.isValid()) {
+    return fallback;
+  }
+  return static_cast<unsigned>(*cost.getValue());
+}
+
+/// @brief Cost of a sequence and of its barrier calls
+static unsigned sequenceCost(const AlgebraicSubstitutionInterface &sub,
+                             ArrayRef<unsigned> ops, unsigned barrierValues,
+                             const TargetTransformInfo *TTI,
+                             LLVMContext &ctx) {
+  unsigned total = 0;
+  for (auto opcode : ops) {
+    total += opcodeCost(opcode, TTI, ctx);
+  }
+
+  auto &barrier = sub.getBarrier();
+  total += barrierValues * barrier.valueCost();
+  total += sub.barrierConstants() * barrier.constantCost();
+  return total;
+}
+
+unsigned estimateSubstitutionCost(const AlgebraicSubstitutionInterface &sub,
+                                  const TargetTransformInfo *TTI,
+                                  LLVMContext &ctx) {
+  return sequenceCost(sub, sub.opcodes(), sub.barrierValues(), TTI, ctx);
+}
+
+unsigned estimateSiteCost(const AlgebraicSubstitutionInterface &sub,
+                          const TargetTransformInfo *TTI, const Module &M,
+                          const utils::RandomEngine &rand) {
+  SmallVector<unsigned, 32> ops;
+  auto barrierValues = sub.siteShape(M, rand, ops);
+  return sequenceCost(sub, ops, barrierValues, TTI, M.getContext());
+}
+
+} // namespace global_value_hide
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "substitution.h"
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+
+namespace global_value_hide {
+
+/// @brief Estimates the cost of one decrypt expression of a substitution
+///
+/// Sums the cost of every opcode the substitution declares, as reported by
+/// TargetTransformInfo for the target of the function the expression is
+/// emitted in, plus the documented cost of its optimization barrier calls.
+/// Without TTI every instruction costs 1 and every load 4.
+///
+/// @param sub Substitution to estimate
+/// @param TTI Target cost model, may be null
+/// @param ctx LLVM context for type creation
+/// @return Estimated cost in TTI size-and-latency units
+unsigned estimateSubstitutionCost(const AlgebraicSubstitutionInterface &sub,
+                                  const llvm::TargetTransformInfo *TTI,
+                                  llvm::LLVMContext &ctx);
+
+/// @brief Estimates the cost of the expression a substitution emits for one
+/// site
+///
+/// Same as estimateSubstitutionCost, but prices the sequence
+/// AlgebraicSubstitutionInterface::siteShape reports for the site's engine,
+/// for substitutions that synthesize a different expression per site.
+///
+/// @param sub Substitution to estimate
+/// @param TTI Target cost model, may be null
+/// @param M Module the sequence is emitted in
+/// @param rand Engine the site's substitution() receives
+/// @return Estimated cost in TTI size-and-latency units
+unsigned estimateSiteCost(const AlgebraicSubstitutionInterface &sub,
+                          const llvm::TargetTransformInfo *TTI,
+                          const llvm::Module &M,
+                          const utils::RandomEngine &rand);
+
+} // namespace global_value_hide
@@ -0,0 +1,44 @@
+#include "annotations.h"
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/GlobalVariable.h>
+
+using namespace llvm;
+
+namespace global_value_hide {
+
+AnnotationMap collectAnnotations(const Module &M) {
+  AnnotationMap annotations;
+  auto *annotationsGV = M.getNamedGlobal("llvm.global.annotations");
+  if (!annotationsGV || !annotationsGV->hasInitializer()) {
+    return annotations;
+  }
+
+  auto *entries = dyn_cast<ConstantArray>(annotationsGV->getInitializer());
+  if (!entries) {
+    return annotations;
+  }
+
+  for (auto &entry : entries->operands()) {
+    auto *fields = dyn_cast<ConstantStruct>(entry);
+    if (!fields || fields->getNumOperands() < 2) {
+      continue;
+    }
+
+    auto *annotated =
+        dyn_cast<GlobalValue>(fields->getOperand(0)->stripPointerCasts());
+    auto *stringGV =
+        dyn_cast<GlobalVariable>(fields->getOperand(1)->stripPointerCasts());
+    if (!annotated || !stringGV || !stringGV->hasInitializer()) {
+      continue;
+    }
+
+    if (auto *data = dyn_cast<ConstantDataSequential>(
+            stringGV->getInitializer());
+        data && data->isCString()) {
+      annotations[annotated].push_back(data->getAsCString());
+    }
+  }
+  return annotations;
+}
+
+} // namespace global_value_hide
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/GlobalValue.h>
+#include <llvm/IR/Module.h>
+
+namespace global_value_hide {
+
+/// @brief Source annotations of every global value in a module.
+using AnnotationMap = llvm::DenseMap<const llvm::GlobalValue *,
+                                     llvm::SmallVector<llvm::StringRef, 1>>;
+
+/// @brief Reads `__attribute__((annotate("...")))` strings of global values.
+///
+/// Clang records them in the `llvm.global.annotations` array as
+/// `{ ptr value, ptr string, ptr file, i32 line, ptr args }` entries.
+///
+/// @param M Module to read.
+/// @return Annotation strings per annotated global value.
+AnnotationMap collectAnnotations(const llvm::Module &M);
+
+} // namespace global_value_hide
@@ -0,0 +1,47 @@
+#include "batching.h"
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/Support/CommandLine.h>
+
+using namespace llvm;
+
+static cl::opt<bool>
+    Batch("gvhide-batch", cl::init(false),
+          cl::desc("Decrypt the sites of one block with a single vector "
+                   "sequence"));
+
+static cl::opt<unsigned> BatchWidth(
+    "gvhide-batch-width", cl::init(0),
+    cl::desc("Sites decrypted per batch (0: 64-bit lanes of the target's "
+             "vector registers)"));
+
+namespace global_value_hide {
+
+DecryptBatching::DecryptBatching(Module &M, ModuleAnalysisManager *MAM)
+    : FAM_(nullptr), enabled_(Batch) {
+  if (MAM && enabled_ && !BatchWidth) {
+    FAM_ = &MAM->getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+  }
+}
+
+void DecryptBatching::prepare(Function &F) {
+  if (!enabled_ || !FAM_) {
+    return;
+  }
+
+  auto &TTI = FAM_->getResult<TargetIRAnalysis>(F);
+  auto bits = TTI.getRegisterBitWidth(
+      TargetTransformInfo::RGK_FixedWidthVector);
+  lanes_[&F] = bits.getFixedValue() / 64;
+}
+
+unsigned DecryptBatching::lanes(const Function &F) const {
+  if (!enabled_) {
+    return 0;
+  }
+  if (BatchWidth) {
+    return BatchWidth;
+  }
+  return lanes_.lookup(&F);
+}
+
+} // namespace global_value_hide
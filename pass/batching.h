@@ -0,0 +1,53 @@
+#pragma once
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/PassManager.h>
+
+namespace global_value_hide {
+
+/// @brief Optional batching of the decrypt sequences of one block.
+///
+/// Fresh sequences emitted into the same block, from the same table and with
+/// the same vectorizable substitution (or the plain subtraction of the cheap
+/// action) are merged into one: their slots are loaded as a vector, with a
+/// single load when the slots are adjacent, the substitution runs once over
+/// all lanes with one key per lane, and every site extracts its lane. A batch
+/// holds at most as many lanes as a vector register of the function's target
+/// has 64-bit elements.
+///
+/// Enabled with `-gvhide-batch`; `-gvhide-batch-width=N` overrides the number
+/// of lanes. Without an analysis manager the target is unknown and only an
+/// explicit width enables batching.
+///
+/// Widths are fetched by `prepare`, so functions can be planned and queried
+/// concurrently.
+class DecryptBatching {
+private:
+  llvm::FunctionAnalysisManager *FAM_; ///< Source of TTI.
+  bool enabled_;                       ///< Whether `-gvhide-batch` is set.
+  llvm::DenseMap<const llvm::Function *, unsigned>
+      lanes_; ///< Lanes of the prepared functions.
+
+public:
+  /// @brief Constructs the batching stage for a module.
+  /// @param M Module being transformed.
+  /// @param MAM Module analysis manager of the running pipeline, used to
+  /// query the vector register width of each function's target.
+  DecryptBatching(llvm::Module &M, llvm::ModuleAnalysisManager *MAM);
+
+  /// @brief Whether batching is active.
+  bool enabled() const { return enabled_; }
+
+  /// @brief Fetches the vector width of a function that holds sites.
+  /// @param F Function to prepare; must be called before lanes().
+  void prepare(llvm::Function &F);
+
+  /// @brief Maximum number of sites decrypted by one batch in a function.
+  /// @param F Prepared function.
+  /// @return Number of lanes; below 2 when the function is not batched.
+  unsigned lanes(const llvm::Function &F) const;
+};
+
+} // namespace global_value_hide
@@ -1,10 +1,22 @@
 #include "collector.h"
+#include <llvm/ADT/Statistic.h>
+#include <llvm/Support/TimeProfiler.h>
+
+#define DEBUG_TYPE "global-value-hide"
+
+STATISTIC(NumGlobalsCollected, "Global variables collected");
+STATISTIC(NumFunctionsCollected, "Functions collected");
 
 namespace global_value_hide {
 
 void GlobalValueCollector::collect() {
-  gvs_ = Collector<llvm::GlobalVariable>(M_);
-  funcs_ = Collector<llvm::Function>(M_);
+  llvm::TimeTraceScope scope("GlobalValueCollector::collect",
+                             M_.getModuleIdentifier());
+  gvs_ = Collector<llvm::GlobalVariable>(M_, filter_, levels_);
+  funcs_ = Collector<llvm::Function>(M_, filter_, levels_);
+
+  NumGlobalsCollected += gvs_.size();
+  NumFunctionsCollected += funcs_.size();
 }
 
-} // namespace global_value_hide
\ No newline at end of file
+} // namespace global_value_hide
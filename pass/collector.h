@@ -1,7 +1,13 @@
 #pragma once
 
+#include "levels.h"
+#include "marker.h"
 #include "prelude.h"
+#include "symbol_filter.h"
+#include <llvm/ADT/STLExtras.h>
 #include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Intrinsics.h>
 #include <llvm/IR/Module.h>
 #include <vector>
 
@@ -17,72 +23,152 @@ class GlobalValueCollector {
   friend class GlobalValHideManager;
 
 private:
-  llvm::Module &M_;  ///< Reference to the target LLVM module.
-  Funcs funcs_;      ///< Collected functions in the module.
-  GlobalValues gvs_; ///< Collected global variables in the module.
+  llvm::Module &M_;             ///< Reference to the target LLVM module.
+  const SymbolFilter &filter_;  ///< Allow/deny rules for symbols.
+  const FunctionLevels &levels_; ///< Per-function obfuscation levels.
+  Funcs funcs_;                 ///< Collected functions in the module.
+  GlobalValues gvs_;            ///< Collected global variables in the module.
 
 public:
   /// @brief Constructor for GlobalValueCollector.
   /// @param M The LLVM module to collect global values from.
-  explicit GlobalValueCollector(llvm::Module &M) : M_(M) {};
+  /// @param filter Allow/deny rules selecting the symbols to hide.
+  /// @param levels Per-function levels; uses in `off` functions are not
+  /// rewritten.
+  GlobalValueCollector(llvm::Module &M, const SymbolFilter &filter,
+                       const FunctionLevels &levels)
+      : M_(M), filter_(filter), levels_(levels) {};
 
-  /// @brief Collects all global variables and functions in the module.
+  /// @brief Collects the global variables and functions the filter admits
+  /// and the replacer has a use to rewrite in.
   /// @details Populates funcs_ and gvs_ by iterating through the module's
   /// contents.
   void collect();
 };
 
 /// @brief Traits class template for collecting specific types of global values.
+///
+/// Only values with at least one use the replacer rewrites, outside functions
+/// at level `off`, are collected: any other value would get a slot, and the
+/// table a reference keeping it alive, for nothing.
+///
 /// @tparam T Type of global value to collect (llvm::Function or
 /// llvm::GlobalVariable).
 template <typename T> struct CollecTrait {
   /// @brief Collects global values of type T from the module.
   /// @param M The LLVM module to collect from.
+  /// @param filter Allow/deny rules selecting the symbols to hide.
+  /// @param levels Per-function obfuscation levels.
   /// @return std::vector<T*> containing pointers to the collected values.
-  static std::vector<T *> collect(llvm::Module &M);
+  static std::vector<T *> collect(llvm::Module &M, const SymbolFilter &filter,
+                                  const FunctionLevels &levels);
+
+  /// @brief Checks whether the replacer rewrites a use of a value.
+  static bool rewritable(const llvm::Use &U);
 };
 
 /// @brief Specialization of CollecTrait for collecting llvm::Function objects.
 template <> struct CollecTrait<llvm::Function> {
 
-  /// @brief Collects all functions in the module.
+  /// @brief Collects the functions of the module the filter admits.
+  ///
+  /// Intrinsics have no address and are never collected.
+  ///
   /// @param M The LLVM module to process.
-  /// @return std::vectorllvm::Function* containing all function pointers.
-  static std::vector<llvm::Function *> collect(llvm::Module &M) {
+  /// @param filter Allow/deny rules selecting the symbols to hide.
+  /// @param levels Per-function obfuscation levels.
+  /// @return std::vectorllvm::Function* containing the function pointers.
+  static std::vector<llvm::Function *> collect(llvm::Module &M,
+                                               const SymbolFilter &filter,
+                                               const FunctionLevels &levels) {
+    auto rewritten = [&](const llvm::Use &U) {
+      return rewritable(U) && levels.rewrites(U);
+    };
     Funcs Fs;
     for (auto &F : M) {
-      Fs.push_back(&F);
+      if (!F.isIntrinsic() && llvm::any_of(F.uses(), rewritten) &&
+          filter.admits(F)) {
+        Fs.push_back(&F);
+      }
     }
 
     return Fs;
   }
+
+  /// @brief Checks whether a use is the callee of a call, invoke or callbr.
+  static bool rewritable(const llvm::Use &U) {
+    auto *call = llvm::dyn_cast<llvm::CallBase>(U.getUser());
+    return call && call->isCallee(&U);
+  }
 };
 
 /// @brief Specialization of CollecTrait for collecting llvm::GlobalVariable
 /// objects.
+///
+/// Tables and other globals created by an earlier run of the pass are never
+/// collected, so running the pass twice does not stack decrypt layers.
 template <> struct CollecTrait<llvm::GlobalVariable> {
 
-  /// @brief Collects all global variables in the module.
+  /// @brief Collects the global variables of the module the filter admits.
+  ///
+  /// Thread-local variables have no link-time address to put in a table and
+  /// are never collected.
+  ///
   /// @param M The LLVM module to process.
-  /// @return std::vectorllvm::GlobalVariable* containing all global variable
+  /// @param filter Allow/deny rules selecting the symbols to hide.
+  /// @param levels Per-function obfuscation levels.
+  /// @return std::vectorllvm::GlobalVariable* containing the global variable
   /// pointers.
-  static GlobalValues collect(llvm::Module &M) {
+  static GlobalValues collect(llvm::Module &M, const SymbolFilter &filter,
+                              const FunctionLevels &levels) {
+    auto rewritten = [&](const llvm::Use &U) {
+      return rewritable(U) && levels.rewrites(U);
+    };
     GlobalValues GVs;
     for (auto &GV : M.globals()) {
-      GVs.push_back(&GV);
+      if (!GV.isThreadLocal() && !generatedRole(GV) &&
+          llvm::any_of(GV.uses(), rewritten) && filter.admits(GV)) {
+        GVs.push_back(&GV);
+      }
     }
 
     return GVs;
   }
+
+  /// @brief Checks whether an instruction operand may become a decrypted
+  /// address.
+  ///
+  /// Uses inside constant expressions are not rewritten. Neither are operands
+  /// that must stay constant: exception handling pads, the type info of
+  /// `llvm.eh.typeid.for` and `immarg` arguments.
+  static bool rewritable(const llvm::Use &U) {
+    auto *I = llvm::dyn_cast<llvm::Instruction>(U.getUser());
+    if (!I || I->isEHPad()) {
+      return false;
+    }
+    if (auto *call = llvm::dyn_cast<llvm::CallBase>(I);
+        call && call->isArgOperand(&U)) {
+      auto *callee = call->getCalledFunction();
+      return !call->paramHasAttr(call->getArgOperandNo(&U),
+                                 llvm::Attribute::ImmArg) &&
+             !(callee &&
+               callee->getIntrinsicID() == llvm::Intrinsic::eh_typeid_for);
+    }
+    return true;
+  }
 };
 
 /// @brief Helper function to collect global values using CollecTrait.
 /// @tparam T Type of global value to collect (llvm::Function or
 /// llvm::GlobalVariable).
 /// @param M The LLVM module to collect from.
+/// @param filter Allow/deny rules selecting the symbols to hide.
+/// @param levels Per-function obfuscation levels.
 /// @return std::vector<T*> containing pointers to the collected values.
-template <typename T> std::vector<T *> Collector(llvm::Module &M) {
-  return CollecTrait<T>::collect(M);
+template <typename T>
+std::vector<T *> Collector(llvm::Module &M, const SymbolFilter &filter,
+                           const FunctionLevels &levels) {
+  return CollecTrait<T>::collect(M, filter, levels);
 }
 
 }; // namespace global_value_hide
\ No newline at end of file
@@ -0,0 +1,102 @@
+#include "cost_model.h"
+#include "algebraic_substitution/substitutionCost.h"
+#include <algorithm>
+#include <cassert>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Analysis/BlockFrequencyInfo.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/Support/CommandLine.h>
+
+using namespace llvm;
+
+static cl::opt<uint64_t> CostBudget(
+    "gvhide-cost-budget", cl::init(0),
+    cl::desc("Frequency-weighted substitution cost each function may spend "
+             "(0: unlimited)"));
+
+static cl::opt<uint64_t> SiteCostBudget(
+    "gvhide-site-cost-budget", cl::init(0),
+    cl::desc("Frequency-weighted substitution cost a single decrypt site may "
+             "spend (0: unlimited)"));
+
+namespace global_value_hide {
+
+CostModel::CostModel(Module &M, ModuleAnalysisManager *MAM)
+    : FAM_(nullptr), functionBudget_(CostBudget),
+      siteBudget_(SiteCostBudget) {
+  if (MAM && enabled()) {
+    FAM_ = &MAM->getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+  }
+}
+
+void CostModel::prepare(Function &F, const AlgSubList &subs) {
+  if (!enabled()) {
+    return;
+  }
+
+  auto &fc = functions_[&F];
+  if (FAM_) {
+    fc.TTI = &FAM_->getResult<TargetIRAnalysis>(F);
+    fc.BFI = &FAM_->getResult<BlockFrequencyAnalysis>(F);
+  }
+  fc.costs.clear();
+  for (auto &sub : subs) {
+    fc.costs.push_back(
+        estimateSubstitutionCost(*sub, fc.TTI, F.getContext()));
+  }
+}
+
+uint64_t CostModel::frequencyScale(const FunctionCosts &fc,
+                                   const Instruction &at) const {
+  if (!fc.BFI) {
+    return 1;
+  }
+
+  auto &F = *at.getFunction();
+  uint64_t entry = fc.BFI->getBlockFreq(&F.getEntryBlock()).getFrequency();
+  uint64_t freq = fc.BFI->getBlockFreq(at.getParent()).getFrequency();
+  return entry == 0 ? 1 : std::max<uint64_t>(1, freq / entry);
+}
+
+AlgebraicSubstitutionInterface &
+CostModel::select(Instruction &at, AlgebraicSubstitutionChoose &chooser,
+                  AlgebraicSubstitutionInterface &moduleChoice,
+                  utils::RandomEngine &rand, uint64_t constSeed,
+                  bool light) {
+  if (!enabled()) {
+    return moduleChoice;
+  }
+
+  auto it = functions_.find(at.getFunction());
+  assert(it != functions_.end() && "function was not prepared");
+  auto &fc = it->second;
+  auto &subs = chooser.substitutions();
+  SmallVector<unsigned, 4> costs(fc.costs.begin(), fc.costs.end());
+  for (size_t i = 0; i < subs.size(); ++i) {
+    if (subs[i]->variesPerSite()) {
+      costs[i] = estimateSiteCost(*subs[i], fc.TTI, *at.getModule(),
+                                  utils::RandomEngine(constSeed));
+    }
+  }
+  uint64_t scale = frequencyScale(fc, at);
+
+  uint64_t maxCost = UINT64_MAX;
+  if (siteBudget_) {
+    maxCost = siteBudget_ / scale;
+  }
+  auto &spent = fc.spent;
+  if (functionBudget_) {
+    uint64_t remaining = spent < functionBudget_ ? functionBudget_ - spent : 0;
+    maxCost = std::min(maxCost, remaining / scale);
+  }
+
+  auto &sub = chooser.choose(rand, costs, maxCost, light);
+  for (size_t i = 0; i < subs.size(); ++i) {
+    if (subs[i].get() == &sub) {
+      spent += costs[i] * scale;
+    }
+  }
+  return sub;
+}
+
+} // namespace global_value_hide
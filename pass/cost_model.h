@@ -0,0 +1,87 @@
+#pragma once
+
+#include "algebraic_substitution/substitutionChoose.h"
+#include "utils/utils.h"
+#include <cstdint>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Analysis/BlockFrequencyInfo.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instruction.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/PassManager.h>
+
+namespace global_value_hide {
+
+/// @brief Cost-weighted, per-site choice of the algebraic substitution.
+///
+/// Every registered substitution is priced with TargetTransformInfo for the
+/// function a site is in; one that synthesizes a different expression per
+/// site (mba) is priced per site, on the expression that site will emit. A
+/// site is weighted by how often its block runs per function entry, so the
+/// same substitution is more expensive in a loop than in straight-line code.
+/// Two budgets bound the choice:
+///
+/// - `-gvhide-cost-budget`: weighted cost a function may spend in total;
+/// - `-gvhide-site-cost-budget`: weighted cost a single site may spend.
+///
+/// Each site picks at random among the substitutions that fit, or the
+/// cheapest one. With both budgets at zero the model is disabled and every
+/// site uses the substitution chosen for the whole module.
+///
+/// Prices and frequencies are fetched by `prepare`; `select` only touches the
+/// state of the site's function, so functions can be planned concurrently.
+class CostModel {
+private:
+  /// @brief Prices and spending of one function.
+  struct FunctionCosts {
+    llvm::BlockFrequencyInfo *BFI = nullptr; ///< Block frequencies, if any.
+    const llvm::TargetTransformInfo *TTI = nullptr; ///< Target costs, if any.
+    llvm::SmallVector<unsigned, 4> costs; ///< Cost of every substitution.
+    uint64_t spent = 0;                   ///< Weighted cost spent so far.
+  };
+
+  llvm::FunctionAnalysisManager *FAM_; ///< Source of TTI and block frequency.
+  uint64_t functionBudget_;            ///< Weighted cost per function.
+  uint64_t siteBudget_;                ///< Weighted cost per site.
+  llvm::DenseMap<const llvm::Function *, FunctionCosts>
+      functions_; ///< State of the prepared functions.
+
+  /// @brief Returns how many times a block runs per entry of its function.
+  uint64_t frequencyScale(const FunctionCosts &fc,
+                          const llvm::Instruction &at) const;
+
+public:
+  /// @brief Constructs the cost model for a module.
+  /// @param M Module being transformed.
+  /// @param MAM Module analysis manager of the running pipeline. Without it
+  /// substitutions are priced with the generic fallback and every site has
+  /// weight one.
+  CostModel(llvm::Module &M, llvm::ModuleAnalysisManager *MAM);
+
+  /// @brief Whether a budget is configured.
+  bool enabled() const { return functionBudget_ != 0 || siteBudget_ != 0; }
+
+  /// @brief Prices every substitution for a function's target.
+  /// @param F Function holding decrypt sites.
+  /// @param subs Registered substitutions.
+  void prepare(llvm::Function &F, const AlgSubList &subs);
+
+  /// @brief Picks the substitution for a site and charges its cost.
+  /// @param at Instruction the decrypt sequence is inserted before; its
+  /// function must have been prepared.
+  /// @param chooser Registry of substitutions.
+  /// @param moduleChoice Substitution used when the model is disabled.
+  /// @param rand Engine of the site.
+  /// @param constSeed Seed of the engine the substitution is emitted with.
+  /// @param light Only pick among light substitutions.
+  /// @return The substitution to emit.
+  AlgebraicSubstitutionInterface &
+  select(llvm::Instruction &at, AlgebraicSubstitutionChoose &chooser,
+         AlgebraicSubstitutionInterface &moduleChoice,
+         utils::RandomEngine &rand, uint64_t constSeed, bool light = false);
+};
+
+} // namespace global_value_hide
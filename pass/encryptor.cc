@@ -1,13 +1,64 @@
 #include "encryptor.h"
 #include "prelude.h"
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/Support/TimeProfiler.h>
+
+#define DEBUG_TYPE "global-value-hide"
 
 using namespace llvm;
 
+STATISTIC(NumGlobalsHidden, "Global variables placed in an encrypted table");
+STATISTIC(NumFunctionsHidden, "Functions placed in an encrypted table");
+STATISTIC(NumTableBytes, "Bytes of encrypted tables emitted");
+STATISTIC(NumTables, "Encrypted tables emitted");
+STATISTIC(NumSlotsReused, "Values keeping the slot of an earlier run");
+
 namespace global_value_hide {
 
+/// @brief Counts the tables the values were placed in and their size.
+template <typename T>
+static void countTables(const Module &M,
+                        const std::vector<EncryptedValue<T>> &vals) {
+  SmallPtrSet<const GlobalVariable *, 4> tables;
+  for (auto &ev : vals) {
+    if (tables.insert(ev.encryptedGV).second) {
+      ++NumTables;
+      NumTableBytes += M.getDataLayout().getTypeAllocSize(
+          ev.encryptedGV->getValueType());
+    }
+  }
+}
+
+/// @brief Counts the values that kept a slot of an earlier run.
+template <typename T>
+static unsigned countReused(const std::vector<EncryptedValue<T>> &vals,
+                            const SlotMap &existing) {
+  return llvm::count_if(vals, [&](const EncryptedValue<T> &ev) {
+    return existing.count(ev.originalValue);
+  });
+}
+
 void GlobalValueEncryptor::enc(GlobalValues &gv, Funcs &func) {
-  gv_ = Encryptor<GlobalVariable>(M_, gv);
-  func_ = Encryptor<Function>(M_, func);
+  TimeTraceScope scope("GlobalValueEncryptor::enc", M_.getModuleIdentifier());
+  // on a module the pass already ran on, symbols keep their slot
+  SlotMap gvSlots, funcSlots;
+  if (isProcessed(M_)) {
+    gvSlots = existingSlots(M_, "globals");
+    funcSlots = existingSlots(M_, "functions");
+  }
+
+  gv_ = Encryptor<GlobalVariable>(M_, gv, seeds_, layout_, gvSlots);
+  func_ = Encryptor<Function>(M_, func, seeds_, layout_, funcSlots);
+
+  NumGlobalsHidden += gv_.size();
+  NumFunctionsHidden += func_.size();
+  auto reused = countReused(gv_, gvSlots) + countReused(func_, funcSlots);
+  addedTables_ = gv_.size() + func_.size() > reused;
+  NumSlotsReused += reused;
+  countTables(M_, gv_);
+  countTables(M_, func_);
 }
 
-} // namespace global_value_hide
\ No newline at end of file
+} // namespace global_value_hide
@@ -1,11 +1,17 @@
 #pragma once
 
+#include "layout.h"
+#include "marker.h"
 #include "prelude.h"
+#include "seed.h"
 #include "utils/utils.h"
+#include <cstdint>
 #include <llvm/IR/Constant.h>
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/GlobalVariable.h>
 #include <llvm/IR/Module.h>
+#include <llvm/Support/Alignment.h>
+#include <type_traits>
 
 namespace global_value_hide {
 
@@ -19,71 +25,160 @@ class GlobalValueEncryptor {
   friend class GlobalValHideManager;
 
 private:
-  llvm::Module &M_;  ///< Reference to the target LLVM module.
-  EncGvsInfo gv_;    ///< Metadata of encrypted global variables.
-  EncFunsInfo func_; ///< Metadata of encrypted functions.
+  llvm::Module &M_;         ///< Reference to the target LLVM module.
+  const SeedSource &seeds_; ///< Source of the encryption keys.
+  TableLayout &layout_;     ///< Order and sharding of the tables.
+  EncGvsInfo gv_;           ///< Metadata of encrypted global variables.
+  EncFunsInfo func_;        ///< Metadata of encrypted functions.
+  bool addedTables_ = false; ///< Whether enc() emitted any table.
 
 public:
   /// @brief Constructor for GlobalValueEncryptor.
   /// @param M The LLVM module to encrypt values in.
-  explicit GlobalValueEncryptor(llvm::Module &M) : M_(M) {};
+  /// @param seeds Source of the encryption keys.
+  /// @param layout Order and sharding of the tables.
+  GlobalValueEncryptor(llvm::Module &M, const SeedSource &seeds,
+                       TableLayout &layout)
+      : M_(M), seeds_(seeds), layout_(layout) {};
 
   /// @brief Encrypts the provided global variables and functions.
   /// @param gv Global variables to encrypt.
   /// @param func Functions to encrypt.
   void enc(GlobalValues &gv, Funcs &func);
+
+  /// @brief Whether enc() emitted tables, i.e. some value had no slot yet.
+  bool addedTables() const { return addedTables_; }
 };
 
 /// @brief Encryption trait for generating obfuscated pointers.
 /// @tparam T Type of value to encrypt (llvm::GlobalVariable or llvm::Function).
 template <typename T> class EncTrait {
 private:
-  /// @brief Creates an encrypted pointer by adding a random key offset.
+  /// @brief Half-width of the range relative slot keys are drawn from.
+  ///
+  /// The linker checks that offset plus key fits 32 bits, so keys stay below
+  /// 2^30 and leave room for images up to 1 GiB.
+  static constexpr int64_t RELATIVE_KEY_RANGE = int64_t(1) << 30;
+
+  /// @brief Creates an encrypted pointer by adding a key offset.
   /// @param ptr Original pointer to the global value.
+  /// @param key Key added to the pointer.
   /// @param ctx LLVM context for type creation.
   /// @return llvm::Constant* representing the encrypted pointer expression.
   static llvm::Constant *createEncryptedPointer(llvm::Constant *ptr,
+                                                llvm::Constant *key,
                                                 llvm::LLVMContext &ctx) {
-    static auto randEngine = utils::RandomEngine();
-    auto key = randEngine.getUint64();
-    auto keyVal = llvm::ConstantInt::get(llvm::Type::getInt64Ty(ctx), key);
-
     return llvm::ConstantExpr::getGetElementPtr(
         llvm::Type::getInt8Ty(ctx),
         llvm::ConstantExpr::getBitCast(ptr,
                                  llvm::PointerType::get(llvm::Type::getInt8Ty(ctx), 0)),
-        keyVal);
+        key);
+  }
+
+  /// @brief Creates a relative slot, `target - table + key` truncated to 32
+  /// bits, which the static linker resolves.
+  /// @param target Value the slot points to, see TableLayout::relativeTarget.
+  /// @param table Table holding the slot.
+  /// @param key Key added to the offset.
+  /// @return llvm::Constant* of type i32.
+  static llvm::Constant *createRelativeSlot(llvm::Constant *target,
+                                            llvm::GlobalVariable *table,
+                                            llvm::Constant *key) {
+    auto int64Ty = llvm::Type::getInt64Ty(table->getContext());
+    auto offset = llvm::ConstantExpr::getSub(
+        llvm::ConstantExpr::getPtrToInt(target, int64Ty),
+        llvm::ConstantExpr::getPtrToInt(table, int64Ty));
+    return llvm::ConstantExpr::getTrunc(
+        llvm::ConstantExpr::getAdd(offset, key),
+        llvm::Type::getInt32Ty(table->getContext()));
   }
 
 public:
-  /// @brief Encrypts a list of global values and creates an encrypted global
-  /// array.
+  /// @brief Encrypts a list of global values and creates the encrypted global
+  /// arrays.
   /// @param M Target module to modify.
   /// @param vals List of global values to encrypt.
-  /// @return std::vector<EncryptedValue<T>> containing encryption metadata.
-  static std::vector<EncryptedValue<T>> enc(llvm::Module &M,
-                                            std::vector<T *> &vals) {
-    auto int8PtrTy = llvm::PointerType::get(llvm::Type::getInt8Ty(M.getContext()), 0);
-    std::vector<llvm::Constant *> encryptedPtrs;
+  /// @param seeds Source of the encryption keys; each key only depends on the
+  /// symbol name, or on its position for unnamed values.
+  /// @param layout Decides the shard, slot and slot format of every value.
+  /// @param existing Slots left by an earlier run of the pass; values found
+  /// there keep their slot and key instead of getting a new one.
+  /// @return std::vector<EncryptedValue<T>> containing encryption metadata,
+  /// in the order of vals.
+  static std::vector<EncryptedValue<T>>
+  enc(llvm::Module &M, std::vector<T *> &vals, const SeedSource &seeds,
+      TableLayout &layout, const SlotMap &existing) {
+    auto &ctx = M.getContext();
+    auto int64Ty = llvm::Type::getInt64Ty(ctx);
     std::vector<EncryptedValue<T>> encryptedGlobals;
+    std::vector<llvm::Constant *> targets; ///< Relative targets, by value.
+    std::vector<llvm::GlobalValue *> fresh[2]; ///< Values needing a new
+                                               ///< pointer or relative slot.
+    std::vector<size_t> freshIndex[2];         ///< Their index in vals.
 
     // encrypt all object in vals
     for (size_t i = 0; i < vals.size(); ++i) {
-      auto encPtr = createEncryptedPointer(vals[i], M.getContext());
-      encryptedPtrs.push_back(encPtr);
+      targets.push_back(nullptr);
+      if (auto it = existing.find(vals[i]); it != existing.end()) {
+        auto &slot = it->second;
+        encryptedGlobals.push_back(
+            {slot.encryptedGV, slot.encryptionKey, slot.index, vals[i]});
+        continue;
+      }
+
+      auto rand = seeds.engine({"key", vals[i]->getName()},
+                               vals[i]->hasName() ? 0 : i);
+      targets[i] = layout.relativeTarget(*vals[i]);
+      bool relative = targets[i] != nullptr;
+      auto key = rand.getUint64();
+      if (relative) {
+        key = key % (2 * RELATIVE_KEY_RANGE) - RELATIVE_KEY_RANGE;
+      }
       encryptedGlobals.push_back(
-          {nullptr, llvm::dyn_cast<llvm::Constant>(encPtr->getOperand(1)), i, vals[i]});
+          {nullptr, llvm::ConstantInt::get(int64Ty, key), i, vals[i]});
+      fresh[relative].push_back(vals[i]);
+      freshIndex[relative].push_back(i);
     }
 
-    // create encrypted global value array
-    auto arrTy = llvm::ArrayType::get(int8PtrTy, encryptedPtrs.size());
-    auto encGV = new llvm::GlobalVariable(M, arrTy, true, llvm::GlobalValue::PrivateLinkage,
-                                    llvm::ConstantArray::get(arrTy, encryptedPtrs),
-                                    "__encrypted_globals");
+    // create one encrypted global value array per shard and slot format
+    for (bool relative : {false, true}) {
+      llvm::Type *slotTy = llvm::Type::getInt32Ty(ctx);
+      if (!relative) {
+        slotTy = llvm::PointerType::get(llvm::Type::getInt8Ty(ctx), 0);
+      }
+      for (auto &shard : layout.shards(fresh[relative])) {
+        auto arrTy = llvm::ArrayType::get(slotTy, shard.size());
+        auto encGV = new llvm::GlobalVariable(M, arrTy, true, llvm::GlobalValue::PrivateLinkage,
+                                              nullptr, "__encrypted_globals");
+
+        // updata encrypted global value index in array
+        std::vector<llvm::Constant *> slots;
+        for (size_t slot = 0; slot < shard.size(); ++slot) {
+          auto i = freshIndex[relative][shard[slot]];
+          auto &ev = encryptedGlobals[i];
+          ev.encryptedGV = encGV;
+          ev.index = slot;
+          slots.push_back(
+              relative ? createRelativeSlot(targets[i], encGV, ev.encryptionKey)
+                       : createEncryptedPointer(vals[i], ev.encryptionKey, ctx));
+        }
+
+        encGV->setInitializer(llvm::ConstantArray::get(arrTy, slots));
+        if (layout.alignment()) {
+          encGV->setAlignment(llvm::Align(layout.alignment()));
+        }
+        markGenerated(*encGV, std::is_same_v<T, llvm::Function> ? "functions"
+                                                                 : "globals");
+      }
+    }
 
-    // updata encrypted global value index in array
+    // intern the slot addresses the decrypt sequences load from
+    auto int32Ty = llvm::Type::getInt32Ty(ctx);
     for (auto &ev : encryptedGlobals) {
-      ev.encryptedGV = encGV;
+      llvm::Constant *indices[] = {llvm::ConstantInt::get(int32Ty, 0),
+                                   llvm::ConstantInt::get(int32Ty, ev.index)};
+      ev.slot = llvm::ConstantExpr::getInBoundsGetElementPtr(
+          ev.encryptedGV->getValueType(), ev.encryptedGV, indices);
     }
 
     return encryptedGlobals;
@@ -94,11 +189,17 @@ public:
 /// @tparam T Type of value to encrypt.
 /// @param M Target module.
 /// @param vals List of values to encrypt.
+/// @param seeds Source of the encryption keys.
+/// @param layout Order and sharding of the tables.
+/// @param existing Slots left by an earlier run of the pass.
 /// @return std::vector<EncryptedValue<T>> containing encryption metadata.
 template <typename T>
 std::vector<EncryptedValue<T>> Encryptor(llvm::Module &M,
-                                         std::vector<T *> &vals) {
-  return EncTrait<T>::enc(M, vals);
+                                         std::vector<T *> &vals,
+                                         const SeedSource &seeds,
+                                         TableLayout &layout,
+                                         const SlotMap &existing = {}) {
+  return EncTrait<T>::enc(M, vals, seeds, layout, existing);
 }
 
 } // namespace global_value_hide
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "gv_hide.h"
 #include "collector.h"
+#include "marker.h"
 #include <llvm/IR/Attributes.h>
 #include <llvm/IR/Constant.h>
 #include <llvm/IR/Constants.h>
@@ -15,15 +16,45 @@
 #include <llvm/IR/Type.h>
 #include <llvm/IR/User.h>
 #include <llvm/Support/Casting.h>
+#include <llvm/Support/CommandLine.h>
 
 using namespace llvm;
 
+static cl::opt<bool>
+    Fast("gvhide-fast", cl::init(false),
+         cl::desc("Emit decrypt sequences without value names or per-site "
+                  "metadata"));
+
 namespace global_value_hide {
 
 void GlobalValHideManager::run() {
-  collector_->collect();
+  collect();
+  encrypt();
+  replace();
+}
+
+void GlobalValHideManager::collect() { collector_->collect(); }
+
+void GlobalValHideManager::encrypt() {
   encryptor_->enc(collector_->gvs_, collector_->funcs_);
-  replacer_->replace(encryptor_->gv_, encryptor_->func_);
+}
+
+void GlobalValHideManager::replace() {
+  // the context drops the names before any string is built
+  auto &ctx = M_.getContext();
+  bool discardNames = ctx.shouldDiscardValueNames();
+  ctx.setDiscardValueNames(discardNames || Fast);
+  replacer_->replace(encryptor_->gv_, encryptor_->func_, Fast);
+  ctx.setDiscardValueNames(discardNames);
+  markProcessed(M_);
+}
+
+bool GlobalValHideManager::changed() const {
+  return encryptor_->addedTables() || !replacer_->changedFunctions().empty();
+}
+
+ArrayRef<Function *> GlobalValHideManager::changedFunctions() const {
+  return replacer_->changedFunctions();
 }
 
 } // namespace global_value_hide
\ No newline at end of file
@@ -1,9 +1,19 @@
 #pragma once
 
+#include "batching.h"
 #include "collector.h"
+#include "cost_model.h"
 #include "encryptor.h"
+#include "layout.h"
+#include "levels.h"
+#include "placement.h"
+#include "policy.h"
+#include "remarks.h"
+#include "seed.h"
+#include "symbol_filter.h"
 #include "replacer.h"
 #include <cstdint>
+#include <llvm/ADT/ArrayRef.h>
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/Function.h>
@@ -14,8 +24,10 @@
 #include <llvm/IR/Instruction.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
+#include <llvm/IR/PassManager.h>
 #include <llvm/IR/Value.h>
 #include <memory>
+#include <optional>
 #include <vector>
 
 const uint32_t OPAQUE_PREDICATE_ARGV_MIN = 2;
@@ -25,9 +37,34 @@ namespace global_value_hide {
 /// @brief Central manager class for global value hiding operations.
 /// @details Coordinates collection, encryption, and replacement phases
 /// to obfuscate global values in an LLVM module.
+///
+/// Everything a run mutates is owned by the manager or by the module and its
+/// context: the seed source and every engine derived from it, the
+/// substitutions and their barrier, and the per-function analyses. Only
+/// command line options and statistics are process-wide, and both are safe
+/// to use from several threads. Managers of different modules, such as those
+/// of in-process ThinLTO backends, can therefore run concurrently.
 class GlobalValHideManager {
 private:
   llvm::Module &M_; ///< Reference to the target LLVM module.
+  std::unique_ptr<SeedSource>
+      seeds_; ///< Source of every random draw on the module.
+  std::unique_ptr<SymbolFilter>
+      filter_; ///< Selects the symbols to hide.
+  std::unique_ptr<FunctionLevels>
+      levels_; ///< Obfuscation level of each function.
+  std::unique_ptr<SitePolicy>
+      policy_; ///< Decides how each decrypt site is rewritten.
+  std::unique_ptr<DecryptPlacement>
+      placement_; ///< Reuses and hoists decrypted values.
+  std::unique_ptr<CostModel>
+      costs_; ///< Picks the substitution of each site.
+  std::unique_ptr<DecryptBatching>
+      batching_; ///< Merges the decrypt sequences of one block.
+  std::unique_ptr<SiteRemarks>
+      remarks_; ///< Reports what happened to each site.
+  std::unique_ptr<TableLayout>
+      layout_; ///< Orders and shards the encrypted tables.
   std::unique_ptr<GlobalValueCollector>
       collector_; ///< Collects global values/functions.
   std::unique_ptr<GlobalValueEncryptor>
@@ -38,10 +75,27 @@ private:
 public:
   /// @brief Constructs a manager for the given module.
   /// @param M The LLVM module to obfuscate.
-  explicit GlobalValHideManager(llvm::Module &M) : M_(M) {
-    collector_ = std::make_unique<GlobalValueCollector>(M_);
-    encryptor_ = std::make_unique<GlobalValueEncryptor>(M_);
-    replacer_ = std::make_unique<GlobalValueReplacer>(M_.getContext());
+  /// @param MAM Analysis manager of the running pipeline, used for profile
+  /// and block frequency queries. May be null outside a pass pipeline.
+  /// @param seed Base seed given as a pass parameter, if any.
+  explicit GlobalValHideManager(llvm::Module &M,
+                                llvm::ModuleAnalysisManager *MAM = nullptr,
+                                std::optional<uint64_t> seed = std::nullopt)
+      : M_(M) {
+    seeds_ = std::make_unique<SeedSource>(M_, seed);
+    filter_ = std::make_unique<SymbolFilter>(M_);
+    levels_ = std::make_unique<FunctionLevels>(M_);
+    policy_ = std::make_unique<SitePolicy>(M_, MAM);
+    placement_ = std::make_unique<DecryptPlacement>(M_, MAM);
+    costs_ = std::make_unique<CostModel>(M_, MAM);
+    batching_ = std::make_unique<DecryptBatching>(M_, MAM);
+    remarks_ = std::make_unique<SiteRemarks>(M_, MAM);
+    collector_ = std::make_unique<GlobalValueCollector>(M_, *filter_, *levels_);
+    layout_ = std::make_unique<TableLayout>(M_);
+    encryptor_ = std::make_unique<GlobalValueEncryptor>(M_, *seeds_, *layout_);
+    replacer_ = std::make_unique<GlobalValueReplacer>(
+        M_.getContext(), *levels_, *policy_, *placement_, *costs_, *batching_,
+        *remarks_, *seeds_);
   };
 
   /// @brief Executes the full obfuscation workflow:
@@ -49,6 +103,22 @@ public:
   /// 2. Encrypt collected values
   /// 3. Replace original references
   void run();
+
+  /// @brief Runs the collection phase only.
+  void collect();
+
+  /// @brief Runs the encryption phase only; requires collect().
+  void encrypt();
+
+  /// @brief Runs the replacement phase only; requires encrypt().
+  void replace();
+
+  /// @brief Whether the run changed the module.
+  bool changed() const;
+
+  /// @brief Functions whose instructions the run changed; their CFG is
+  /// preserved. Other functions are left untouched.
+  llvm::ArrayRef<llvm::Function *> changedFunctions() const;
 };
 
 } // namespace global_value_hide
@@ -0,0 +1,201 @@
+#include "layout.h"
+#include <algorithm>
+#include <climits>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/InstrTypes.h>
+#include <llvm/IR/Instruction.h>
+#include <llvm/Support/CommandLine.h>
+#if LLVM_VERSION_MAJOR >= 17
+#include <llvm/TargetParser/Triple.h>
+#else
+#include <llvm/ADT/Triple.h>
+#endif
+
+using namespace llvm;
+
+static cl::opt<global_value_hide::LayoutOrder> Layout(
+    "gvhide-layout", cl::init(global_value_hide::LayoutOrder::Flat),
+    cl::desc("Order of the slots in the encrypted tables"),
+    cl::values(clEnumValN(global_value_hide::LayoutOrder::Flat, "flat",
+                          "Collection order"),
+               clEnumValN(global_value_hide::LayoutOrder::CoUse, "couse",
+                          "Group slots used by the same function and its "
+                          "callees"),
+               clEnumValN(global_value_hide::LayoutOrder::Hot, "hot",
+                          "Like couse, hottest functions first")));
+
+static cl::opt<unsigned>
+    ShardSlots("gvhide-shard-slots", cl::init(0),
+               cl::desc("Maximum number of slots per encrypted table shard "
+                        "(0: a single table)"));
+
+static cl::opt<unsigned> CacheLine(
+    "gvhide-cache-line", cl::init(64),
+    cl::desc("Alignment in bytes of reordered or sharded encrypted tables"));
+
+static cl::opt<global_value_hide::SlotFormat> TableFormat(
+    "gvhide-table-format", cl::init(global_value_hide::SlotFormat::Absolute),
+    cl::desc("Format of the slots of the encrypted tables"),
+    cl::values(clEnumValN(global_value_hide::SlotFormat::Absolute, "absolute",
+                          "Encrypted pointers"),
+               clEnumValN(global_value_hide::SlotFormat::Relative, "relative",
+                          "32-bit table-relative offsets, no dynamic "
+                          "relocations")));
+
+namespace global_value_hide {
+
+TableLayout::TableLayout(Module &M)
+    : M_(M), order_(Layout), shardSlots_(ShardSlots), alignment_(0),
+      format_(TableFormat),
+      elf_(Triple(M.getTargetTriple()).isOSBinFormatELF()) {
+  if (order_ != LayoutOrder::Flat || shardSlots_ != 0) {
+    alignment_ = CacheLine;
+  }
+}
+
+Constant *TableLayout::relativeTarget(GlobalValue &GV) const {
+  if (format_ != SlotFormat::Relative) {
+    return nullptr;
+  }
+  if (GV.isDSOLocal()) {
+    return &GV;
+  }
+#if LLVM_VERSION_MAJOR >= 15
+  // calls may go through the PLT entry the static linker provides; the
+  // LLVM 14 IR parser cannot read forward references to the equivalent back
+  if (auto *F = dyn_cast<Function>(&GV); F && elf_) {
+    return DSOLocalEquivalent::get(F);
+  }
+#endif
+  return nullptr;
+}
+
+/// @brief Returns the profile entry count of a function, 0 without profile.
+static uint64_t entryCount(const Function &F) {
+  auto count = F.getEntryCount();
+  return count ? count->getCount() : 0;
+}
+
+const std::vector<Function *> &TableLayout::functionOrder() {
+  if (!functions_.empty()) {
+    return functions_;
+  }
+
+  std::vector<Function *> roots;
+  for (auto &F : M_) {
+    if (!F.isDeclaration()) {
+      roots.push_back(&F);
+    }
+  }
+  if (order_ == LayoutOrder::Hot) {
+    std::stable_sort(roots.begin(), roots.end(),
+                     [](const Function *a, const Function *b) {
+                       return entryCount(*a) > entryCount(*b);
+                     });
+  }
+
+  // preorder walk over direct calls, so callees follow their first caller
+  SmallPtrSet<Function *, 32> visited;
+  SmallVector<Function *, 16> stack;
+  for (auto *root : roots) {
+    if (!visited.insert(root).second) {
+      continue;
+    }
+    stack.push_back(root);
+    while (!stack.empty()) {
+      auto *F = stack.pop_back_val();
+      functions_.push_back(F);
+
+      SmallVector<Function *, 8> callees;
+      for (auto &I : instructions(F)) {
+        auto *call = dyn_cast<CallBase>(&I);
+        auto *callee = call ? call->getCalledFunction() : nullptr;
+        if (callee && !callee->isDeclaration() &&
+            visited.insert(callee).second) {
+          callees.push_back(callee);
+        }
+      }
+      stack.append(callees.rbegin(), callees.rend());
+    }
+  }
+  return functions_;
+}
+
+std::vector<std::vector<size_t>>
+TableLayout::groups(ArrayRef<GlobalValue *> vals) {
+  if (order_ == LayoutOrder::Flat) {
+    std::vector<size_t> all(vals.size());
+    for (size_t i = 0; i < vals.size(); ++i) {
+      all[i] = i;
+    }
+    return {all};
+  }
+
+  DenseMap<const Function *, unsigned> rank;
+  for (auto *F : functionOrder()) {
+    rank.try_emplace(F, rank.size());
+  }
+
+  // each value goes with the first function in walk order that uses it;
+  // values without instruction uses go last
+  std::vector<unsigned> first(vals.size(), UINT_MAX);
+  for (size_t i = 0; i < vals.size(); ++i) {
+    for (auto *user : vals[i]->users()) {
+      if (auto *I = dyn_cast<Instruction>(user)) {
+        auto it = rank.find(I->getFunction());
+        if (it != rank.end()) {
+          first[i] = std::min(first[i], it->second);
+        }
+      }
+    }
+  }
+
+  std::vector<size_t> sorted(vals.size());
+  for (size_t i = 0; i < vals.size(); ++i) {
+    sorted[i] = i;
+  }
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [&](size_t a, size_t b) { return first[a] < first[b]; });
+
+  std::vector<std::vector<size_t>> result;
+  for (size_t i = 0; i < sorted.size(); ++i) {
+    if (i == 0 || first[sorted[i]] != first[sorted[i - 1]]) {
+      result.emplace_back();
+    }
+    result.back().push_back(sorted[i]);
+  }
+  return result;
+}
+
+std::vector<std::vector<size_t>>
+TableLayout::shards(ArrayRef<GlobalValue *> vals) {
+  std::vector<std::vector<size_t>> result;
+  if (vals.empty()) {
+    return result;
+  }
+
+  result.emplace_back();
+  for (auto &group : groups(vals)) {
+    auto *shard = &result.back();
+    // keep a function's slots together when they fit in a shard of their own
+    if (shardSlots_ && !shard->empty() &&
+        shard->size() + group.size() > shardSlots_ &&
+        group.size() <= shardSlots_) {
+      shard = &result.emplace_back();
+    }
+    for (auto index : group) {
+      if (shardSlots_ && shard->size() == shardSlots_) {
+        shard = &result.emplace_back();
+      }
+      shard->push_back(index);
+    }
+  }
+  return result;
+}
+
+} // namespace global_value_hide
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalValue.h>
+#include <llvm/IR/Module.h>
+#include <vector>
+
+namespace global_value_hide {
+
+/// @brief Order of the slots in the encrypted tables.
+enum class LayoutOrder {
+  Flat,  ///< Collection order.
+  CoUse, ///< Grouped by the function that uses them, call graph order.
+  Hot,   ///< Like CoUse, functions with the highest entry count first.
+};
+
+/// @brief Format of the slots of the encrypted tables.
+enum class SlotFormat {
+  Absolute, ///< Encrypted pointer: 8 bytes and, in PIC, a dynamic relocation.
+  Relative, ///< 32-bit offset from the table plus key, resolved at link time.
+};
+
+/// @brief Layout stage of the encrypted tables.
+///
+/// Decides which table a hidden value's slot goes to and where. With
+/// `-gvhide-layout=couse`, functions are visited in call graph preorder
+/// (callers followed by their callees) and each value is placed with the
+/// first function that references it, so the slots a function and its
+/// callees load are adjacent. `-gvhide-layout=hot` starts the walk at the
+/// functions with the highest profile entry count.
+///
+/// `-gvhide-shard-slots=N` splits a table into shards of at most N slots,
+/// starting a new shard rather than splitting the slots of one function when
+/// they fit in a shard of their own. Reordered or sharded tables are aligned
+/// to `-gvhide-cache-line` bytes.
+///
+/// `-gvhide-table-format=relative` stores each slot as a 32-bit offset from
+/// its table plus key, in the style of relative vtables, for every value the
+/// static linker can resolve; the tables then need no load-time relocation.
+/// Values that may be preempted at load time keep pointer slots in tables of
+/// their own.
+class TableLayout {
+private:
+  llvm::Module &M_;    ///< Module being transformed.
+  LayoutOrder order_;  ///< Slot order.
+  unsigned shardSlots_; ///< Slots per shard, 0 for a single table.
+  unsigned alignment_;  ///< Table alignment in bytes, 0 for the default.
+  SlotFormat format_;   ///< Preferred slot format.
+  bool elf_;            ///< Whether the target has dso_local_equivalent.
+  std::vector<llvm::Function *> functions_; ///< Walk order, computed once.
+
+  /// @brief Computes the order functions are visited in.
+  const std::vector<llvm::Function *> &functionOrder();
+
+  /// @brief Splits values into runs of slots that belong together.
+  /// @param vals Values in collection order.
+  /// @return Runs of indices into vals, in table order.
+  std::vector<std::vector<size_t>>
+  groups(llvm::ArrayRef<llvm::GlobalValue *> vals);
+
+public:
+  /// @brief Reads the layout options.
+  /// @param M Module being transformed.
+  explicit TableLayout(llvm::Module &M);
+
+  /// @brief Assigns values to shards.
+  /// @param vals Values of one kind, in collection order.
+  /// @return Indices into vals of the slots of each shard, in slot order.
+  /// Empty when vals is empty.
+  std::vector<std::vector<size_t>>
+  shards(llvm::ArrayRef<llvm::GlobalValue *> vals);
+
+  /// @brief Returns the alignment of the tables in bytes, 0 for the default.
+  unsigned alignment() const { return alignment_; }
+
+  /// @brief Returns what a relative slot of a value is an offset to.
+  /// @param GV Value to place.
+  /// @return The value itself, its `dso_local_equivalent` for preemptible
+  /// functions on ELF, or null if the value needs a pointer slot.
+  llvm::Constant *relativeTarget(llvm::GlobalValue &GV) const;
+};
+
+} // namespace global_value_hide
@@ -0,0 +1,55 @@
+#include "levels.h"
+#include "annotations.h"
+#include <llvm/ADT/StringSwitch.h>
+#include <llvm/ADT/Twine.h>
+#include <llvm/IR/Instruction.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/Support/Casting.h>
+#include <optional>
+
+using namespace llvm;
+
+namespace global_value_hide {
+
+FunctionLevels::FunctionLevels(const Module &M) {
+  for (auto &entry : collectAnnotations(M)) {
+    auto *F = dyn_cast<Function>(entry.first);
+    if (!F) {
+      continue;
+    }
+
+    for (auto annotation : entry.second) {
+      if (!annotation.consume_front("gvhide=")) {
+        continue;
+      }
+      auto level = StringSwitch<std::optional<HideLevel>>(annotation)
+                       .Case("off", HideLevel::Off)
+                       .Case("light", HideLevel::Light)
+                       .Case("full", HideLevel::Full)
+                       .Default(std::nullopt);
+      if (!level) {
+        // a typo in user source, not a compiler crash
+        M.getContext().emitError("gvhide: unknown level '" +
+                                 Twine(annotation) + "' on function '" +
+                                 F->getName() + "'");
+        continue;
+      }
+      levels_[F] = *level;
+    }
+  }
+}
+
+HideLevel FunctionLevels::level(const Function &F) const {
+  auto it = levels_.find(&F);
+  return it == levels_.end() ? HideLevel::Full : it->second;
+}
+
+bool FunctionLevels::rewrites(const Use &U) const {
+  if (levels_.empty()) {
+    return true;
+  }
+  auto *I = cast<Instruction>(U.getUser());
+  return level(*I->getFunction()) != HideLevel::Off;
+}
+
+} // namespace global_value_hide
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Use.h>
+
+namespace global_value_hide {
+
+/// @brief How much of the pass applies to the sites inside a function.
+enum class HideLevel {
+  Off,   ///< Sites are left untouched.
+  Light, ///< Sites only use light substitutions.
+  Full,  ///< Sites use every registered substitution.
+};
+
+/// @brief Per-function obfuscation levels set from source.
+///
+/// A function annotated with `__attribute__((annotate("gvhide=<level>")))`,
+/// where the level is `off`, `light` or `full`, decides how the uses of
+/// hidden values inside its own body are rewritten. Unannotated functions are
+/// `full`. The level does not affect whether the function itself is hidden;
+/// that is the symbol filter's job.
+class FunctionLevels {
+private:
+  llvm::DenseMap<const llvm::Function *, HideLevel>
+      levels_; ///< Levels of the annotated functions.
+
+public:
+  /// @brief Reads the levels of a module's annotated functions.
+  ///
+  /// An unknown level is reported as an error of the module's context and
+  /// otherwise ignored; with several `gvhide=` annotations on one function,
+  /// the last one applies.
+  ///
+  /// @param M Module to read.
+  explicit FunctionLevels(const llvm::Module &M);
+
+  /// @brief Level of a function.
+  HideLevel level(const llvm::Function &F) const;
+
+  /// @brief Checks whether the instruction holding a use is rewritten at all.
+  /// @param U Use by an instruction.
+  bool rewrites(const llvm::Use &U) const;
+};
+
+} // namespace global_value_hide
@@ -0,0 +1,96 @@
+#include "marker.h"
+#include <llvm/IR/Constants.h>
+
+using namespace llvm;
+
+namespace global_value_hide {
+
+std::optional<StringRef> generatedRole(const GlobalValue &GV) {
+  auto *GO = dyn_cast<GlobalObject>(&GV);
+  auto *node = GO ? GO->getMetadata(GENERATED_MD) : nullptr;
+  if (!node || node->getNumOperands() == 0) {
+    return std::nullopt;
+  }
+  if (auto *role = dyn_cast<MDString>(node->getOperand(0))) {
+    return role->getString();
+  }
+  return std::nullopt;
+}
+
+bool isProcessed(const Module &M) {
+  return M.getModuleFlag(PROCESSED_FLAG) != nullptr;
+}
+
+void markProcessed(Module &M) {
+  if (!isProcessed(M)) {
+    // Max lets LTO merge processed and unprocessed modules
+    M.addModuleFlag(Module::Max, PROCESSED_FLAG, 1);
+  }
+}
+
+/// @brief Decodes one table slot.
+/// @return The symbol and key of the slot, or nothing if the slot has
+/// another form.
+static std::optional<std::pair<GlobalValue *, Constant *>>
+decodeSlot(Constant *slot) {
+  auto *CE = dyn_cast<ConstantExpr>(slot);
+  if (!CE) {
+    return std::nullopt;
+  }
+
+  Constant *target = nullptr;
+  Constant *key = nullptr;
+  if (CE->getOpcode() == Instruction::GetElementPtr &&
+      CE->getNumOperands() == 2) {
+    target = CE->getOperand(0)->stripPointerCasts();
+    key = CE->getOperand(1);
+  } else if (CE->getOpcode() == Instruction::Trunc) {
+    // relative slot: trunc (sub (ptrtoint target, ptrtoint table) + key)
+    auto *add = dyn_cast<ConstantExpr>(CE->getOperand(0));
+    auto *offset =
+        add && add->getOpcode() == Instruction::Add
+            ? dyn_cast<ConstantExpr>(add->getOperand(0))
+            : nullptr;
+    auto *ptr = offset && offset->getOpcode() == Instruction::Sub
+                    ? dyn_cast<ConstantExpr>(offset->getOperand(0))
+                    : nullptr;
+    if (ptr && ptr->getOpcode() == Instruction::PtrToInt) {
+      target = ptr->getOperand(0);
+      key = add->getOperand(1);
+      if (auto *equivalent = dyn_cast<DSOLocalEquivalent>(target)) {
+        target = equivalent->getGlobalValue();
+      }
+    }
+  }
+
+  if (auto *symbol = dyn_cast_or_null<GlobalValue>(target)) {
+    return std::make_pair(symbol, key);
+  }
+  return std::nullopt;
+}
+
+SlotMap existingSlots(const Module &M, StringRef role) {
+  SlotMap slots;
+  for (auto &GV : M.globals()) {
+    if (generatedRole(GV) != role || !GV.hasInitializer()) {
+      continue;
+    }
+
+    auto *init = dyn_cast<ConstantArray>(GV.getInitializer());
+    if (!init) {
+      continue;
+    }
+    for (unsigned i = 0; i < init->getNumOperands(); ++i) {
+      if (auto decoded = decodeSlot(init->getOperand(i))) {
+        auto [symbol, key] = *decoded;
+        slots.try_emplace(symbol,
+                          EncryptedValue<GlobalValue>{
+                              const_cast<GlobalVariable *>(&GV), key, i,
+                              symbol});
+      }
+    }
+  }
+  return slots;
+}
+
+} // namespace global_value_hide
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "prelude.h"
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Metadata.h>
+#include <llvm/IR/Module.h>
+#include <optional>
+
+namespace global_value_hide {
+
+/// @brief Table slots by symbol.
+using SlotMap =
+    llvm::DenseMap<const llvm::GlobalValue *, EncryptedValue<llvm::GlobalValue>>;
+
+/// @brief Metadata kind attached to every global the pass creates.
+///
+/// The attachment is `!gvhide !{!"<role>"}`, with the role `globals` or
+/// `functions` for tables and `barrier` for the volatile-load barrier.
+constexpr const char *GENERATED_MD = "gvhide";
+
+/// @brief Module flag set once the pass has run on a module.
+constexpr const char *PROCESSED_FLAG = "gvhide.processed";
+
+/// @brief Marks a global as created by the pass, so later runs skip it.
+/// @param GV Global created by the pass.
+/// @param role What the global is used for.
+inline void markGenerated(llvm::GlobalVariable &GV, llvm::StringRef role) {
+  auto &ctx = GV.getContext();
+  GV.setMetadata(GENERATED_MD,
+                 llvm::MDNode::get(ctx, llvm::MDString::get(ctx, role)));
+}
+
+/// @brief Returns the role of a global created by the pass.
+/// @param GV Any global value.
+/// @return The role given to markGenerated, or nothing for other globals.
+std::optional<llvm::StringRef> generatedRole(const llvm::GlobalValue &GV);
+
+/// @brief Checks whether the pass already ran on a module.
+bool isProcessed(const llvm::Module &M);
+
+/// @brief Records that the pass ran on a module.
+void markProcessed(llvm::Module &M);
+
+/// @brief Decodes the slots of the tables of one role.
+///
+/// Every slot of a table holds `getelementptr (i8, ptr @symbol, i64 key)`,
+/// or, in relative tables, `trunc (@symbol - @table + key)`.
+/// When the tables of several runs or modules hold the same symbol, the
+/// first slot found wins.
+///
+/// @param M Module to search.
+/// @param role Role of the tables, `globals` or `functions`.
+/// @return Slot metadata by symbol.
+SlotMap existingSlots(const llvm::Module &M, llvm::StringRef role);
+
+} // namespace global_value_hide
@@ -1,34 +1,186 @@
 #include "pass.h"
 #include "gv_hide.h"
+#include <cstdlib>
 #include <llvm/Config/llvm-config.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/SymbolTableListTraits.h>
 #include <llvm/IR/Value.h>
 #include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/raw_ostream.h>
 
 using namespace llvm;
 
+namespace {
+
+/// Where in the default pipelines the plugin inserts the pass.
+enum class ExtensionPoint {
+  PipelineStart,
+  OptimizerLast,
+  ThinLTOBackend,
+  FullLTOLast
+};
+
+} // namespace
+
+static cl::opt<ExtensionPoint> HideAt(
+    "gvhide-ep", cl::init(ExtensionPoint::PipelineStart),
+    cl::desc("Where the plugin runs in the default pipelines"),
+    cl::values(clEnumValN(ExtensionPoint::PipelineStart, "start",
+                          "Before any optimization (default)"),
+               clEnumValN(ExtensionPoint::OptimizerLast, "optimizer-last",
+                          "After inlining and the rest of the optimizer"),
+               clEnumValN(ExtensionPoint::ThinLTOBackend, "thinlto-backend",
+                          "At the end of each ThinLTO backend"),
+               clEnumValN(ExtensionPoint::FullLTOLast, "full-lto-last",
+                          "Once on the merged module of a full-LTO link")));
+
+static cl::opt<bool> WholeProgramMode(
+    "gvhide-lto", cl::init(false),
+    cl::desc("Hide symbols once for the whole program at the full-LTO "
+             "post-link stage instead of in every translation unit "
+             "(same as -gvhide-ep=full-lto-last)"));
+
+/// @brief Extension point selected on the command line.
+static ExtensionPoint extensionPoint() {
+  return WholeProgramMode ? ExtensionPoint::FullLTOLast : HideAt.getValue();
+}
+
+/// @brief Stops on a command line the plugin cannot honour. It is a user
+/// error: unlike report_fatal_error, this prints no stack dump or bug-report
+/// banner.
+[[noreturn]] static void rejectOptions(const Twine &message) {
+  errs() << "error: " << message << "\n";
+  exit(1);
+}
+
+/// @brief Rejects an extension point this LLVM cannot run the pass at,
+/// rather than leaving the output silently unobfuscated.
+static void checkExtensionPoint() {
+#if LLVM_VERSION_MAJOR < 16
+  if (WholeProgramMode) {
+    rejectOptions("gvhide: -gvhide-lto needs LLVM 16 or later; run "
+                  "global-value-hide after the LTO pipeline instead");
+  }
+  if (HideAt == ExtensionPoint::FullLTOLast) {
+    rejectOptions("gvhide: -gvhide-ep=full-lto-last needs LLVM 16 or later; "
+                  "run global-value-hide after the LTO pipeline instead");
+  }
+#endif
+#if LLVM_VERSION_MAJOR < 20
+  // the optimizer-last callback cannot tell the ThinLTO backend from the
+  // pre-link and non-LTO pipelines
+  if (HideAt == ExtensionPoint::ThinLTOBackend) {
+    rejectOptions("gvhide: -gvhide-ep=thinlto-backend needs LLVM 20 or later; "
+                  "use -gvhide-ep=optimizer-last instead");
+  }
+#endif
+}
+
 PreservedAnalyses GlobalValueHidePass::run(Module &M,
                                            ModuleAnalysisManager &MAM) {
-  global_value_hide::GlobalValHideManager manager(M);
+  global_value_hide::GlobalValHideManager manager(M, &MAM, Seed);
   manager.run();
-  return PreservedAnalyses::all();
+  if (!manager.changed()) {
+    return PreservedAnalyses::all();
+  }
+
+  // only the rewritten functions lose their analyses, and decrypt sequences
+  // never add or remove blocks
+  auto &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+  PreservedAnalyses FunctionPA;
+  FunctionPA.preserveSet<CFGAnalyses>();
+  for (auto *F : manager.changedFunctions()) {
+    FAM.invalidate(*F, FunctionPA);
+  }
+
+  // tables and indirect calls were added: module analyses such as the call
+  // graph are stale
+  PreservedAnalyses PA;
+  PA.preserveSet<AllAnalysesOn<Function>>();
+  PA.preserve<FunctionAnalysisManagerModuleProxy>();
+  return PA;
+}
+
+/// Parses `global-value-hide` and `global-value-hide<seed=N;lto>`.
+static bool parseGlobalValueHidePass(StringRef Name,
+                                     std::optional<uint64_t> &Seed) {
+  if (Name == "global-value-hide") {
+    return true;
+  }
+  if (!Name.consume_front("global-value-hide<") || !Name.consume_back(">")) {
+    return false;
+  }
+
+  while (!Name.empty()) {
+    StringRef Param;
+    std::tie(Param, Name) = Name.split(';');
+    if (Param == "lto") {
+      // kept for existing pipelines: every run now leaves values without
+      // rewritable uses out of the tables
+      continue;
+    }
+
+    StringRef Arg = Param;
+    uint64_t Value;
+    if (!Arg.consume_front("seed=") || Arg.getAsInteger(0, Value)) {
+      errs() << "global-value-hide: invalid parameter '" << Param << "'\n";
+      return false;
+    }
+    Seed = Value;
+  }
+  return true;
 }
 
 PassPluginLibraryInfo getGlobalValueHidePluginInfo() {
   return {LLVM_PLUGIN_API_VERSION, "GvHide", LLVM_VERSION_STRING,
           [](PassBuilder &PB) {
+            checkExtensionPoint();
             // Use this to support clang usage
             PB.registerPipelineStartEPCallback(
                 [](ModulePassManager &MPM, OptimizationLevel Level) {
-                  MPM.addPass(GlobalValueHidePass());
+                  if (extensionPoint() == ExtensionPoint::PipelineStart) {
+                    MPM.addPass(GlobalValueHidePass());
+                  }
+                });
+#if LLVM_VERSION_MAJOR >= 20
+            PB.registerOptimizerLastEPCallback(
+                [](ModulePassManager &MPM, OptimizationLevel Level,
+                   ThinOrFullLTOPhase Phase) {
+                  // the ThinLTO backend runs this extension point again
+                  auto EP = extensionPoint();
+                  if ((EP == ExtensionPoint::OptimizerLast &&
+                       Phase != ThinOrFullLTOPhase::ThinLTOPreLink) ||
+                      (EP == ExtensionPoint::ThinLTOBackend &&
+                       Phase == ThinOrFullLTOPhase::ThinLTOPostLink)) {
+                    MPM.addPass(GlobalValueHidePass());
+                  }
                 });
+#else
+            PB.registerOptimizerLastEPCallback(
+                [](ModulePassManager &MPM, OptimizationLevel Level) {
+                  if (extensionPoint() == ExtensionPoint::OptimizerLast) {
+                    MPM.addPass(GlobalValueHidePass());
+                  }
+                });
+#endif
+#if LLVM_VERSION_MAJOR >= 16
+            // -gvhide-ep=full-lto-last: once, on the merged module of a
+            // full-LTO link
+            PB.registerFullLinkTimeOptimizationLastEPCallback(
+                [](ModulePassManager &MPM, OptimizationLevel Level) {
+                  if (extensionPoint() == ExtensionPoint::FullLTOLast) {
+                    MPM.addPass(GlobalValueHidePass());
+                  }
+                });
+#endif
             PB.registerPipelineParsingCallback(
                 [](StringRef Name, ModulePassManager &MPM,
                    ArrayRef<PassBuilder::PipelineElement>) {
-                  if (Name == "global-value-hide") {
-                    MPM.addPass(GlobalValueHidePass());
+                  std::optional<uint64_t> Seed;
+                  if (parseGlobalValueHidePass(Name, Seed)) {
+                    MPM.addPass(GlobalValueHidePass(Seed));
                     return true;
                   }
                   return false;
@@ -2,11 +2,19 @@
 
 #include "llvm/IR/PassManager.h"
 #include "llvm/Passes/PassPlugin.h"
+#include <cstdint>
+#include <optional>
 
 namespace llvm {
 
 class GlobalValueHidePass : public PassInfoMixin<GlobalValueHidePass> {
+  /// Base seed given as `global-value-hide<seed=N>`, if any.
+  std::optional<uint64_t> Seed;
+
 public:
+  explicit GlobalValueHidePass(std::optional<uint64_t> Seed = std::nullopt)
+      : Seed(Seed) {}
+
   PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM);
 };
 
@@ -0,0 +1,129 @@
+#include "placement.h"
+#include <algorithm>
+#include <cassert>
+#include <llvm/Support/CommandLine.h>
+
+using namespace llvm;
+
+static cl::opt<bool> Reuse(
+    "gvhide-reuse", cl::init(false),
+    cl::desc("Decrypt each hidden value once per dominating region and hoist "
+             "the sequence out of loops"));
+
+static cl::opt<unsigned> ReuseMaxLive(
+    "gvhide-reuse-max-live", cl::init(8),
+    cl::desc("Maximum number of reusable decrypted values per function"));
+
+namespace global_value_hide {
+
+DecryptPlacement::DecryptPlacement(Module &M, ModuleAnalysisManager *MAM)
+    : FAM_(nullptr), maxLive_(ReuseMaxLive) {
+  if (MAM && Reuse) {
+    FAM_ = &MAM->getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+  }
+}
+
+DecryptPlacement::FunctionState &
+DecryptPlacement::state(const Function &F) {
+  auto it = functions_.find(&F);
+  assert(it != functions_.end() && "function was not prepared");
+  return it->second;
+}
+
+const DecryptPlacement::FunctionState &
+DecryptPlacement::state(const Function &F) const {
+  auto it = functions_.find(&F);
+  assert(it != functions_.end() && "function was not prepared");
+  return it->second;
+}
+
+void DecryptPlacement::prepare(Function &F) {
+  if (!enabled()) {
+    return;
+  }
+
+  auto &fs = functions_[&F];
+  fs.DT = &FAM_->getResult<DominatorTreeAnalysis>(F);
+  fs.DT->updateDFSNumbers();
+  fs.LI = &FAM_->getResult<LoopAnalysis>(F);
+}
+
+void DecryptPlacement::order(SmallVectorImpl<DecryptSite> &sites) const {
+  if (!enabled() || sites.empty()) {
+    return;
+  }
+
+  auto &DT = *state(*sites.front().at->getFunction()).DT;
+  std::stable_sort(sites.begin(), sites.end(),
+                   [&](const DecryptSite &a, const DecryptSite &b) {
+                     auto *blockA = a.at->getParent();
+                     auto *blockB = b.at->getParent();
+                     if (blockA == blockB) {
+                       return a.at != b.at && a.at->comesBefore(b.at);
+                     }
+                     auto *nodeA = DT.getNode(blockA);
+                     auto *nodeB = DT.getNode(blockB);
+                     if (!nodeA || !nodeB) {
+                       return nodeA != nullptr;
+                     }
+                     return nodeA->getDFSNumIn() < nodeB->getDFSNumIn();
+                   });
+}
+
+std::optional<unsigned> DecryptPlacement::lookup(const GlobalValue &symbol,
+                                                 Instruction &at) const {
+  if (!enabled()) {
+    return std::nullopt;
+  }
+
+  auto &fs = state(*at.getFunction());
+  auto it = fs.available.find(&symbol);
+  if (it == fs.available.end()) {
+    return std::nullopt;
+  }
+
+  // the sequence is emitted right before insertPt, so it dominates `at`
+  // exactly when insertPt is `at` or dominates it
+  for (auto &available : it->second) {
+    if (available.insertPt == &at ||
+        fs.DT->dominates(available.insertPt, &at)) {
+      return available.step;
+    }
+  }
+  return std::nullopt;
+}
+
+Instruction *DecryptPlacement::hoist(Instruction &at) const {
+  if (!enabled() || state(*at.getFunction()).live >= maxLive_) {
+    return &at;
+  }
+
+  // the table is constant, so the decrypted address is loop invariant and
+  // can be computed in the preheader of the outermost enclosing loop
+  auto &LI = *state(*at.getFunction()).LI;
+  Instruction *insertPt = &at;
+  for (auto *L = LI.getLoopFor(at.getParent()); L; L = L->getParentLoop()) {
+    auto *preheader = L->getLoopPreheader();
+    if (!preheader) {
+      break;
+    }
+    insertPt = preheader->getTerminator();
+  }
+  return insertPt;
+}
+
+void DecryptPlacement::record(const GlobalValue &symbol, Instruction &insertPt,
+                              unsigned step) {
+  if (!enabled()) {
+    return;
+  }
+
+  auto &fs = state(*insertPt.getFunction());
+  if (fs.live >= maxLive_) {
+    return;
+  }
+  fs.available[&symbol].push_back({&insertPt, step});
+  ++fs.live;
+}
+
+} // namespace global_value_hide
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "prelude.h"
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instruction.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/PassManager.h>
+#include <optional>
+
+namespace global_value_hide {
+
+/// @brief Optional placement stage for decrypted addresses.
+///
+/// Computes each decrypted address once per dominating region instead of
+/// once per use: a fresh sequence is hoisted out of loops into the outermost
+/// loop preheader, and later sites of the same value that it dominates reuse
+/// it. The number of decrypted values kept live per function is capped so the
+/// reuse does not turn into spills.
+///
+/// Enabled with `-gvhide-reuse`; the cap is `-gvhide-reuse-max-live`. When
+/// disabled, or without an analysis manager, every query is a no-op and sites
+/// are rewritten in place.
+///
+/// The stage works on a plan: it records where sequences will be emitted, not
+/// the emitted values. State is kept per function and created by `prepare`,
+/// so different functions can be planned concurrently.
+class DecryptPlacement {
+private:
+  /// @brief A planned decrypt sequence.
+  struct Available {
+    llvm::Instruction *insertPt; ///< Instruction it is emitted before.
+    unsigned step;               ///< Plan step that emits it.
+  };
+
+  /// @brief Analyses and planned sequences of one function.
+  struct FunctionState {
+    llvm::DominatorTree *DT = nullptr; ///< Dominator tree, DFS numbered.
+    llvm::LoopInfo *LI = nullptr;      ///< Loop nest.
+    llvm::DenseMap<const llvm::GlobalValue *,
+                   llvm::SmallVector<Available, 2>>
+        available;     ///< Planned sequences per hidden value.
+    unsigned live = 0; ///< Number of reusable sequences.
+  };
+
+  llvm::FunctionAnalysisManager *FAM_; ///< Source of per-function analyses.
+  unsigned maxLive_; ///< Cap on reusable values per function.
+  llvm::DenseMap<const llvm::Function *, FunctionState>
+      functions_; ///< State of the prepared functions.
+
+  /// @brief Returns the state of a prepared function.
+  FunctionState &state(const llvm::Function &F);
+  const FunctionState &state(const llvm::Function &F) const;
+
+public:
+  /// @brief Constructs the placement stage for a module.
+  /// @param M Module being transformed.
+  /// @param MAM Module analysis manager of the running pipeline. Without it
+  /// the stage is disabled.
+  DecryptPlacement(llvm::Module &M, llvm::ModuleAnalysisManager *MAM);
+
+  /// @brief Whether reuse and hoisting are active.
+  bool enabled() const { return FAM_ != nullptr; }
+
+  /// @brief Fetches the analyses of a function that holds sites.
+  /// @param F Function to prepare; must be called before any query on it.
+  void prepare(llvm::Function &F);
+
+  /// @brief Orders sites so that dominating sites come first.
+  ///
+  /// Sites are sorted in dominator tree preorder, so the first site of a
+  /// region is the one whose sequence the rest can reuse.
+  ///
+  /// @param sites Sites of a single hidden value in one prepared function.
+  void order(llvm::SmallVectorImpl<DecryptSite> &sites) const;
+
+  /// @brief Finds a planned sequence usable at an instruction.
+  /// @param symbol Hidden value.
+  /// @param at Instruction that needs the decrypted address.
+  /// @return Plan step of a dominating sequence, if any.
+  std::optional<unsigned> lookup(const llvm::GlobalValue &symbol,
+                                 llvm::Instruction &at) const;
+
+  /// @brief Picks the insertion point of a fresh decrypt sequence.
+  /// @param at Instruction that needs the decrypted address.
+  /// @return Terminator of the outermost loop preheader above `at`, or `at`
+  /// itself when not in a loop or when the function is at its cap.
+  llvm::Instruction *hoist(llvm::Instruction &at) const;
+
+  /// @brief Makes a freshly planned sequence available to later sites.
+  /// @param symbol Hidden value.
+  /// @param insertPt Instruction the sequence is emitted before.
+  /// @param step Plan step that emits it.
+  void record(const llvm::GlobalValue &symbol, llvm::Instruction &insertPt,
+              unsigned step);
+};
+
+} // namespace global_value_hide
@@ -0,0 +1,153 @@
+#include "policy.h"
+#include <cassert>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Metadata.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/raw_ostream.h>
+
+using namespace llvm;
+
+static cl::opt<uint64_t> HotThreshold(
+    "gvhide-hot-threshold", cl::init(0),
+    cl::desc("Executions per function entry above which a decrypt site is "
+             "hot (0 disables the hot/cold policy)"));
+
+static cl::opt<global_value_hide::HotSiteAction> HotAction(
+    "gvhide-hot-action", cl::init(global_value_hide::HotSiteAction::Cheap),
+    cl::desc("Treatment of hot decrypt sites"),
+    cl::values(clEnumValN(global_value_hide::HotSiteAction::Cheap, "cheap",
+                          "Use a plain subtraction instead of a substitution"),
+               clEnumValN(global_value_hide::HotSiteAction::Hoist, "hoist",
+                          "Move the sequence to a colder dominating block"),
+               clEnumValN(global_value_hide::HotSiteAction::Skip, "skip",
+                          "Leave the site untouched")));
+
+static cl::opt<bool>
+    ReportPolicy("gvhide-report-policy", cl::init(false),
+                 cl::desc("Print the hot/cold decision of every decrypt site"));
+
+namespace global_value_hide {
+
+SitePolicy::SitePolicy(Module &M, ModuleAnalysisManager *MAM)
+    : M_(M), FAM_(nullptr), PSI_(nullptr), threshold_(HotThreshold),
+      hotAction_(HotAction), report_(ReportPolicy) {
+  // per-module override: !{i32 1, !"gvhide.hot-threshold", i64 N}
+  if (auto *flag = mdconst::extract_or_null<ConstantInt>(
+          M_.getModuleFlag("gvhide.hot-threshold"))) {
+    threshold_ = flag->getZExtValue();
+  }
+
+  if (MAM && threshold_ != 0) {
+    FAM_ = &MAM->getResult<FunctionAnalysisManagerModuleProxy>(M_).getManager();
+    PSI_ = &MAM->getResult<ProfileSummaryAnalysis>(M_);
+  }
+}
+
+bool SitePolicy::isHot(const BasicBlock &BB, BlockFrequencyInfo &BFI) const {
+  if (PSI_->hasProfileSummary() && PSI_->isHotBlock(&BB, &BFI)) {
+    return true;
+  }
+
+  uint64_t entry =
+      BFI.getBlockFreq(&BB.getParent()->getEntryBlock()).getFrequency();
+  uint64_t freq = BFI.getBlockFreq(&BB).getFrequency();
+  if (entry != 0 && threshold_ > UINT64_MAX / entry) {
+    return false;
+  }
+  return freq >= threshold_ * entry;
+}
+
+Instruction *SitePolicy::findColdDominator(BasicBlock &BB,
+                                           const FunctionInfo &info) const {
+  auto *node = info.DT->getNode(&BB);
+  if (!node) {
+    return nullptr;
+  }
+
+  for (node = node->getIDom(); node; node = node->getIDom()) {
+    if (!isHot(*node->getBlock(), *info.BFI)) {
+      return node->getBlock()->getTerminator();
+    }
+  }
+  return nullptr;
+}
+
+void SitePolicy::prepare(Function &F) {
+  if (!enabled()) {
+    return;
+  }
+
+  auto &info = functions_[&F];
+  info.BFI = &FAM_->getResult<BlockFrequencyAnalysis>(F);
+  info.DT = &FAM_->getResult<DominatorTreeAnalysis>(F);
+  info.cold = PSI_->hasProfileSummary() && PSI_->isFunctionEntryCold(&F);
+}
+
+SiteDecision SitePolicy::decide(Instruction &at) const {
+  SiteDecision decision{SiteAction::Full, &at};
+  if (!enabled()) {
+    return decision;
+  }
+
+  auto &BB = *at.getParent();
+  auto it = functions_.find(BB.getParent());
+  assert(it != functions_.end() && "function was not prepared");
+  auto &info = it->second;
+
+  if (!info.cold) {
+    if (isHot(BB, *info.BFI)) {
+      switch (hotAction_) {
+      case HotSiteAction::Cheap:
+        decision.action = SiteAction::Cheap;
+        break;
+      case HotSiteAction::Skip:
+        decision = {SiteAction::Skip, nullptr};
+        break;
+      case HotSiteAction::Hoist:
+        if (auto *cold = findColdDominator(BB, info)) {
+          decision = {SiteAction::Hoist, cold};
+        } else {
+          // no colder dominator, fall back to the cheap expression
+          decision.action = SiteAction::Cheap;
+        }
+        break;
+      }
+    }
+  }
+
+  return decision;
+}
+
+void SitePolicy::report(raw_ostream &OS, const Instruction &at,
+                        const GlobalValue &symbol,
+                        const SiteDecision &decision) const {
+  if (!report_) {
+    return;
+  }
+
+  OS << "gvhide: " << at.getFunction()->getName() << ": " << symbol.getName()
+     << " in " << at.getParent()->getName() << ": "
+     << actionName(decision.action);
+  if (decision.action == SiteAction::Hoist) {
+    OS << " to " << decision.insertPt->getParent()->getName();
+  }
+  OS << "\n";
+}
+
+StringRef SitePolicy::actionName(SiteAction action) {
+  switch (action) {
+  case SiteAction::Full:
+    return "full";
+  case SiteAction::Cheap:
+    return "cheap";
+  case SiteAction::Hoist:
+    return "hoist";
+  case SiteAction::Skip:
+    return "skip";
+  }
+  return "unknown";
+}
+
+} // namespace global_value_hide
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Analysis/BlockFrequencyInfo.h>
+#include <llvm/Analysis/ProfileSummaryInfo.h>
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/Instruction.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/PassManager.h>
+#include <llvm/Support/raw_ostream.h>
+
+namespace global_value_hide {
+
+/// @brief Treatment applied to decrypt sites that the policy considers hot.
+enum class HotSiteAction {
+  Cheap, ///< Emit a plain `encrypted - key` instead of a substitution.
+  Hoist, ///< Emit the full sequence in a colder dominating block.
+  Skip,  ///< Leave the original reference untouched.
+};
+
+/// @brief Action picked by SitePolicy for a single decrypt site.
+enum class SiteAction {
+  Full,  ///< Table load followed by the module's algebraic substitution.
+  Cheap, ///< Table load followed by a plain subtraction of the key.
+  Hoist, ///< Full sequence, emitted at SiteDecision::insertPt.
+  Skip,  ///< Site is not rewritten.
+};
+
+/// @brief Result of SitePolicy::decide for one site.
+struct SiteDecision {
+  /// @brief Action to apply to the site.
+  SiteAction action = SiteAction::Full;
+  /// @brief Instruction before which the decrypt sequence is emitted.
+  llvm::Instruction *insertPt = nullptr;
+};
+
+/// @brief Profile-guided hot/cold policy for decrypt-site insertion.
+///
+/// Classifies each site by the frequency of the block it would be emitted
+/// in. Block frequencies come from BlockFrequencyInfo, which uses
+/// `-fprofile-use` data when the module carries it and static estimates
+/// otherwise; ProfileSummaryInfo additionally marks profile-hot blocks as hot
+/// and profile-cold functions as cold.
+///
+/// A block is hot when it runs at least `threshold` times per entry of its
+/// function. The threshold comes from `-gvhide-hot-threshold` and can be
+/// overridden per module with the `gvhide.hot-threshold` module flag; zero
+/// disables the policy and every site gets SiteAction::Full.
+///
+/// Analyses are fetched by `prepare`, one function at a time; `decide` only
+/// reads them, so functions can be decided on concurrently.
+class SitePolicy {
+private:
+  /// @brief Analyses of one function, cached by `prepare`.
+  struct FunctionInfo {
+    llvm::BlockFrequencyInfo *BFI = nullptr; ///< Block frequencies.
+    llvm::DominatorTree *DT = nullptr;       ///< Dominator tree.
+    bool cold = false; ///< Entry is profile-cold; every site is cold.
+  };
+
+  llvm::Module &M_;                    ///< Module being transformed.
+  llvm::FunctionAnalysisManager *FAM_; ///< Source of per-function analyses.
+  llvm::ProfileSummaryInfo *PSI_;      ///< Module profile summary, if any.
+  uint64_t threshold_;                 ///< Hot threshold, per function entry.
+  HotSiteAction hotAction_;            ///< Treatment of hot sites.
+  bool report_;                        ///< Print every decision to stderr.
+  llvm::DenseMap<const llvm::Function *, FunctionInfo>
+      functions_; ///< Analyses of the prepared functions.
+
+  /// @brief Checks whether a block is hot under the current threshold.
+  /// @param BB Block to classify.
+  /// @param BFI Block frequencies of the enclosing function.
+  /// @return true if the block is hot.
+  bool isHot(const llvm::BasicBlock &BB, llvm::BlockFrequencyInfo &BFI) const;
+
+  /// @brief Finds the nearest dominator of a block that is not hot.
+  /// @param BB Hot block holding the site.
+  /// @param info Analyses of the enclosing function.
+  /// @return Insertion point at the end of that dominator, or nullptr.
+  llvm::Instruction *findColdDominator(llvm::BasicBlock &BB,
+                                       const FunctionInfo &info) const;
+
+public:
+  /// @brief Constructs the policy for a module.
+  /// @param M Module being transformed.
+  /// @param MAM Module analysis manager of the running pipeline. Without it
+  /// the policy is disabled.
+  SitePolicy(llvm::Module &M, llvm::ModuleAnalysisManager *MAM);
+
+  /// @brief Whether the policy can ever pick anything but SiteAction::Full.
+  bool enabled() const { return FAM_ && threshold_ != 0; }
+
+  /// @brief Fetches the analyses `decide` needs for a function.
+  /// @param F Function holding decrypt sites.
+  void prepare(llvm::Function &F);
+
+  /// @brief Picks the action for a decrypt site.
+  /// @param at Instruction the decrypt sequence would be inserted before; its
+  /// function must have been prepared.
+  /// @return The decision; insertPt is always set unless the site is skipped.
+  SiteDecision decide(llvm::Instruction &at) const;
+
+  /// @brief Prints a decision when `-gvhide-report-policy` is set.
+  /// @param OS Stream to print to.
+  /// @param at Instruction passed to `decide`.
+  /// @param symbol Hidden global value.
+  /// @param decision Decision returned by `decide`.
+  void report(llvm::raw_ostream &OS, const llvm::Instruction &at,
+              const llvm::GlobalValue &symbol,
+              const SiteDecision &decision) const;
+
+  /// @brief Returns a printable name of a site action.
+  static llvm::StringRef actionName(SiteAction action);
+};
+
+} // namespace global_value_hide
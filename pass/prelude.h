@@ -2,6 +2,8 @@
 
 #include <llvm/IR/GlobalValue.h>
 #include <llvm/IR/Type.h>
+#include <llvm/IR/Use.h>
+#include <vector>
 
 namespace global_value_hide {
 
@@ -18,10 +20,21 @@ template <typename T> struct EncryptedValue {
   llvm::GlobalVariable *encryptedGV;
   /// @brief Pointer to the encryption key.
   llvm::Constant *encryptionKey;
-  /// @brief Index of the encrypted value in the global value list.
+  /// @brief Index of the value's slot in encryptedGV.
   size_t index;
   /// @brief Pointer to the original global variable or function.
   T *originalValue;
+  /// @brief Address of the value's slot, built once and shared by every
+  /// decrypt sequence.
+  llvm::Constant *slot = nullptr;
+};
+
+/// @brief A single use of a hidden value that receives a decrypt sequence.
+struct DecryptSite {
+  /// @brief Use of the original value to rewrite.
+  llvm::Use *use;
+  /// @brief Instruction the decrypt sequence would naturally precede.
+  llvm::Instruction *at;
 };
 
 using Funcs = std::vector<llvm::Function *>;
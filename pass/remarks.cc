@@ -0,0 +1,115 @@
+#include "remarks.h"
+#include <llvm/Analysis/OptimizationRemarkEmitter.h>
+#include <llvm/IR/DiagnosticInfo.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Support/InstructionCost.h>
+
+#define DEBUG_TYPE "global-value-hide"
+
+using namespace llvm;
+
+namespace global_value_hide {
+
+SiteRemarks::SiteRemarks(Module &M, ModuleAnalysisManager *MAM)
+    : FAM_(nullptr), enabled_(OptimizationRemarkEmitter::allowExtraAnalysis(
+                         M.getContext(), DEBUG_TYPE)) {
+  if (MAM && enabled_) {
+    FAM_ = &MAM->getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+  }
+}
+
+SiteRemarks::FunctionInfo &SiteRemarks::info(Function &F) {
+  auto &info = functions_[&F];
+  if (info.ORE) {
+    return info;
+  }
+
+  if (FAM_) {
+    info.ORE = &FAM_->getResult<OptimizationRemarkEmitterAnalysis>(F);
+    info.BFI = &FAM_->getResult<BlockFrequencyAnalysis>(F);
+    info.TTI = &FAM_->getResult<TargetIRAnalysis>(F);
+  } else {
+    info.ownedORE = std::make_unique<OptimizationRemarkEmitter>(&F);
+    info.ORE = info.ownedORE.get();
+  }
+  return info;
+}
+
+void SiteRemarks::hidden(Instruction &site, const GlobalValue &symbol,
+                         StringRef kind, StringRef action,
+                         BasicBlock::iterator begin, BasicBlock::iterator end,
+                         unsigned sites) {
+  if (!enabled_) {
+    return;
+  }
+
+  auto &fi = info(*site.getFunction());
+  unsigned instructions = 0;
+  unsigned loads = 0;
+  InstructionCost cost = 0;
+  for (auto &I : make_range(begin, end)) {
+    ++instructions;
+    loads += isa<LoadInst>(I);
+    // same fallback as the cost model
+    cost += fi.TTI ? fi.TTI->getInstructionCost(
+                         &I, TargetTransformInfo::TCK_SizeAndLatency)
+                   : InstructionCost(isa<LoadInst>(I) ? 4 : 1);
+  }
+
+  fi.ORE->emit([&] {
+    OptimizationRemark remark(DEBUG_TYPE, "Hidden", &site);
+    remark << "hid " << ore::NV("Symbol", &symbol) << " with "
+           << ore::NV("Substitution", kind) << " ("
+           << ore::NV("Action", action) << "): "
+           << ore::NV("Instructions", instructions) << " instructions, "
+           << ore::NV("Loads", loads) << " loads, cost "
+           << ore::NV("Cost", cost);
+    if (sites > 1) {
+      remark << ", shared by " << ore::NV("BatchSites", sites) << " sites";
+    }
+
+    auto *BB = end->getParent();
+    uint64_t entry =
+        fi.BFI ? fi.BFI->getBlockFreq(&BB->getParent()->getEntryBlock())
+                     .getFrequency()
+               : 0;
+    if (entry != 0) {
+      float frequency =
+          float(fi.BFI->getBlockFreq(BB).getFrequency()) / float(entry);
+      remark << ", block frequency " << ore::NV("BlockFrequency", frequency);
+      if (cost.isValid()) {
+        remark << ", weighted cost "
+               << ore::NV("WeightedCost", float(*cost.getValue()) * frequency);
+      }
+    }
+    return remark;
+  });
+}
+
+void SiteRemarks::reused(Instruction &site, const GlobalValue &symbol) {
+  if (!enabled_) {
+    return;
+  }
+
+  info(*site.getFunction()).ORE->emit([&] {
+    return OptimizationRemark(DEBUG_TYPE, "Reused", &site)
+           << "hid " << ore::NV("Symbol", &symbol)
+           << " with an address decrypted earlier: "
+           << ore::NV("Instructions", 0u) << " instructions added";
+  });
+}
+
+void SiteRemarks::skipped(Instruction &site, const GlobalValue &symbol,
+                          StringRef reason) {
+  if (!enabled_) {
+    return;
+  }
+
+  info(*site.getFunction()).ORE->emit([&] {
+    return OptimizationRemarkMissed(DEBUG_TYPE, "Skipped", &site)
+           << "did not hide " << ore::NV("Symbol", &symbol) << ": "
+           << ore::NV("Reason", reason);
+  });
+}
+
+} // namespace global_value_hide
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Analysis/BlockFrequencyInfo.h>
+#include <llvm/Analysis/OptimizationRemarkEmitter.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalValue.h>
+#include <llvm/IR/Instruction.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/PassManager.h>
+#include <memory>
+
+namespace global_value_hide {
+
+/// @brief Optimization remarks for every decrypt site.
+///
+/// Emitted under the pass name `global-value-hide`, so they are selected
+/// with `-Rpass=global-value-hide` / `-Rpass-missed=global-value-hide` and
+/// recorded by `-fsave-optimization-record` (`-pass-remarks-output` in opt).
+///
+/// - `Hidden`: a fresh sequence decrypts the site. Gives the symbol, the
+///   substitution (or `cheap`), the policy action, the instructions and loads
+///   added, their TTI size-and-latency cost, the frequency of the block they
+///   run in per function entry and that cost weighted by it. A batched
+///   sequence is reported with every site it decrypts, along with their
+///   number.
+/// - `Reused`: the site uses an address decrypted earlier.
+/// - `Skipped` (missed): the site keeps the original reference, and why.
+///
+/// Remarks are only built when the context asks for them. All calls happen
+/// while the replacer runs serially; analyses are fetched on first use.
+class SiteRemarks {
+private:
+  /// @brief Analyses of one function.
+  struct FunctionInfo {
+    llvm::OptimizationRemarkEmitter *ORE = nullptr; ///< Remark sink.
+    std::unique_ptr<llvm::OptimizationRemarkEmitter>
+        ownedORE;                                ///< Sink without a FAM.
+    llvm::BlockFrequencyInfo *BFI = nullptr;     ///< Block frequencies.
+    const llvm::TargetTransformInfo *TTI = nullptr; ///< Cost model.
+  };
+
+  llvm::FunctionAnalysisManager *FAM_; ///< Source of per-function analyses.
+  bool enabled_;                       ///< Whether remarks are requested.
+  llvm::DenseMap<const llvm::Function *, FunctionInfo>
+      functions_; ///< Analyses of the functions remarked on.
+
+  /// @brief Returns the analyses of a function, fetching them if needed.
+  FunctionInfo &info(llvm::Function &F);
+
+public:
+  /// @brief Constructs the remarks for a module.
+  /// @param M Module being transformed.
+  /// @param MAM Module analysis manager of the running pipeline. Without it
+  /// remarks carry no block frequency and costs use the generic fallback.
+  SiteRemarks(llvm::Module &M, llvm::ModuleAnalysisManager *MAM);
+
+  /// @brief Whether remarks are requested.
+  bool enabled() const { return enabled_; }
+
+  /// @brief Reports a site decrypted by a fresh sequence.
+  /// @param site Instruction using the hidden value.
+  /// @param symbol Hidden value.
+  /// @param kind Substitution name, or "cheap".
+  /// @param action Printable policy action.
+  /// @param begin First instruction of the sequence.
+  /// @param end Instruction the sequence was emitted before.
+  /// @param sites Number of sites the sequence decrypts.
+  void hidden(llvm::Instruction &site, const llvm::GlobalValue &symbol,
+              llvm::StringRef kind, llvm::StringRef action,
+              llvm::BasicBlock::iterator begin, llvm::BasicBlock::iterator end,
+              unsigned sites = 1);
+
+  /// @brief Reports a site that reuses an earlier decrypted address.
+  /// @param site Instruction using the hidden value.
+  /// @param symbol Hidden value.
+  void reused(llvm::Instruction &site, const llvm::GlobalValue &symbol);
+
+  /// @brief Reports a site left untouched.
+  /// @param site Instruction using the hidden value.
+  /// @param symbol Hidden value.
+  /// @param reason Why the site is not rewritten.
+  void skipped(llvm::Instruction &site, const llvm::GlobalValue &symbol,
+               llvm::StringRef reason);
+};
+
+} // namespace global_value_hide
@@ -1,27 +1,293 @@
 #include "replacer.h"
 #include "prelude.h"
+#include <algorithm>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/IR/Attributes.h>
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/GlobalValue.h>
 #include <llvm/IR/GlobalVariable.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Type.h>
 #include <llvm/IR/User.h>
+#include <llvm/Support/Allocator.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/StringSaver.h>
+#include <llvm/Support/ThreadPool.h>
+#include <llvm/Support/Threading.h>
+#include <llvm/Support/TimeProfiler.h>
+#include <memory>
+#include <mutex>
+
+#define DEBUG_TYPE "global-value-hide"
 
 using namespace llvm;
 
+STATISTIC(NumSitesRewritten, "Uses rewritten to a decrypted address");
+STATISTIC(NumSitesReused, "Uses rewritten to an already decrypted address");
+STATISTIC(NumSequences, "Decrypt sequences emitted");
+STATISTIC(NumInstructionsAdded, "Instructions added by decrypt sequences");
+STATISTIC(NumLoadsAdded, "Loads added by decrypt sequences");
+STATISTIC(NumBatches, "Batched decrypt sequences emitted");
+STATISTIC(NumBatchedSites, "Uses decrypted by batched sequences");
+
+static cl::opt<unsigned>
+    Threads("gvhide-threads", cl::init(1),
+            cl::desc("Threads planning decrypt sites (0: one per hardware "
+                     "thread)"));
+
 namespace global_value_hide {
 
+namespace {
+
+/// @brief Statistics of one substitution.
+struct SubstitutionStatistics {
+  Statistic sequences;    ///< Sequences emitted.
+  Statistic instructions; ///< Instructions added.
+  Statistic loads;        ///< Loads added.
+};
+
+} // namespace
+
+/// @brief Returns the statistics of a substitution, registering them on
+/// first use.
+static SubstitutionStatistics &substitutionStatistics(StringRef kind) {
+  // statistics are printed at shutdown, so neither they nor their names are
+  // ever freed
+  static std::mutex lock;
+  static auto *saver = new StringSaver(*new BumpPtrAllocator);
+  static auto *stats = new StringMap<std::unique_ptr<SubstitutionStatistics>>;
+
+  std::lock_guard<std::mutex> guard(lock);
+  auto &entry = (*stats)[kind];
+  if (!entry) {
+    auto save = [&](const Twine &text) { return saver->save(text).data(); };
+    entry.reset(new SubstitutionStatistics{
+        {DEBUG_TYPE, save(kind + "Sequences"),
+         save("Decrypt sequences emitted with " + kind)},
+        {DEBUG_TYPE, save(kind + "Instructions"),
+         save("Instructions added by " + kind + " sequences")},
+        {DEBUG_TYPE, save(kind + "Loads"),
+         save("Loads added by " + kind + " sequences")}});
+  }
+  return *entry;
+}
+
+void countSequence(StringRef kind, BasicBlock::iterator begin,
+                   BasicBlock::iterator end) {
+  unsigned instructions = 0;
+  unsigned loads = 0;
+  for (auto &I : make_range(begin, end)) {
+    ++instructions;
+    loads += isa<LoadInst>(I);
+  }
+
+  ++NumSitesRewritten;
+  ++NumSequences;
+  NumInstructionsAdded += instructions;
+  NumLoadsAdded += loads;
+
+  auto &stats = substitutionStatistics(kind);
+  ++stats.sequences;
+  stats.instructions += instructions;
+  stats.loads += loads;
+}
+
+void countBatch(StringRef kind, unsigned sites, BasicBlock::iterator begin,
+                BasicBlock::iterator end) {
+  countSequence(kind, begin, end);
+  NumSitesRewritten += sites - 1;
+  ++NumBatches;
+  NumBatchedSites += sites;
+}
+
+void countReusedSite() {
+  ++NumSitesRewritten;
+  ++NumSitesReused;
+}
+
+SmallVector<Value *, 8>
+createDecryptedAddresses(IRBuilder<> &IRB, LLVMContext &ctx,
+                         GlobalVariable &table, ArrayRef<size_t> indices,
+                         ArrayRef<Constant *> keys,
+                         AlgebraicSubstitutionInterface &sub,
+                         SiteAction action, utils::RandomEngine &rand) {
+  auto tableTy = table.getValueType();
+  auto slotTy = tableTy->getArrayElementType();
+  auto i8Ty = Type::getInt8Ty(ctx);
+  unsigned lanes = indices.size();
+  auto vecTy = FixedVectorType::get(slotTy, lanes);
+  auto slotAddress = [&](size_t index) {
+    Value *idx[] = {IRB.getInt32(0), IRB.getInt32(index)};
+    return IRB.CreateInBoundsGEP(tableTy, &table, idx);
+  };
+
+  Value *slots;
+  bool adjacent = true;
+  for (unsigned i = 1; i < lanes; ++i) {
+    adjacent &= indices[i] == indices[0] + i;
+  }
+  if (adjacent) {
+    auto align = table.getParent()->getDataLayout().getABITypeAlign(slotTy);
+    slots = IRB.CreateAlignedLoad(
+        vecTy,
+        IRB.CreateBitCast(slotAddress(indices[0]), vecTy->getPointerTo()),
+        align);
+  } else {
+    slots = PoisonValue::get(vecTy);
+    for (unsigned i = 0; i < lanes; ++i) {
+      slots = IRB.CreateInsertElement(
+          slots, IRB.CreateLoad(slotTy, slotAddress(indices[i])), i);
+    }
+  }
+
+  Value *encrypted = slots;
+  if (slotTy->isIntegerTy(32)) {
+    // relative slots: the table address plus each slot, as integers so the
+    // encrypted pointers do not carry the table's provenance
+    auto intPtrTy = IRB.getIntPtrTy(table.getParent()->getDataLayout());
+    auto intVecTy = FixedVectorType::get(intPtrTy, lanes);
+    encrypted = IRB.CreateIntToPtr(
+        IRB.CreateAdd(IRB.CreateVectorSplat(
+                          lanes, IRB.CreatePtrToInt(&table, intPtrTy)),
+                      IRB.CreateSExt(slots, intVecTy)),
+        FixedVectorType::get(PointerType::get(i8Ty, 0), lanes));
+  }
+  encrypted->setName("batch__encrypted");
+
+  auto key = ConstantVector::get(keys);
+  Value *decrypted =
+      action == SiteAction::Cheap
+          ? IRB.CreateGEP(i8Ty, encrypted, ConstantExpr::getNeg(key),
+                          "plain_dec")
+          : sub.substitution(IRB, encrypted, key, ctx, rand);
+
+  SmallVector<Value *, 8> addresses;
+  for (unsigned i = 0; i < lanes; ++i) {
+    addresses.push_back(IRB.CreateExtractElement(decrypted, i));
+  }
+  return addresses;
+}
+
+/// @brief Function attributes that describe what a callee does and stay
+/// true for an indirect call to it.
+static constexpr Attribute::AttrKind CALLEE_ATTRS[] = {
+    Attribute::NoUnwind,      Attribute::NoReturn,     Attribute::WillReturn,
+    Attribute::MustProgress,  Attribute::NoSync,       Attribute::NoFree,
+    Attribute::NoCallback,    Attribute::ReturnsTwice, Attribute::Convergent,
+    Attribute::NoDuplicate,   Attribute::NoMerge,      Attribute::Cold,
+    Attribute::Hot,
+#if LLVM_VERSION_MAJOR >= 16
+    Attribute::Memory,
+#else
+    Attribute::ReadNone,      Attribute::ReadOnly,     Attribute::WriteOnly,
+    Attribute::ArgMemOnly,    Attribute::InaccessibleMemOnly,
+    Attribute::InaccessibleMemOrArgMemOnly,
+#endif
+};
+
+void copyCalleeInfo(CallBase &call, const Function &callee) {
+  auto &ctx = call.getContext();
+  auto attrs = call.getAttributes();
+  auto calleeAttrs = callee.getAttributes();
+
+  AttrBuilder fnAttrs(ctx);
+  for (auto kind : CALLEE_ATTRS) {
+    if (calleeAttrs.hasFnAttr(kind)) {
+      fnAttrs.addAttribute(calleeAttrs.getFnAttr(kind));
+    }
+  }
+  attrs = attrs.addFnAttributes(ctx, fnAttrs);
+
+  // argument and return attributes only fit a call of the callee's own type
+  if (call.getFunctionType() == callee.getFunctionType()) {
+    attrs = attrs.addRetAttributes(
+        ctx, AttrBuilder(ctx, calleeAttrs.getRetAttrs()));
+    for (unsigned i = 0, e = callee.arg_size(); i < e; ++i) {
+      attrs = attrs.addParamAttributes(
+          ctx, i, AttrBuilder(ctx, calleeAttrs.getParamAttrs(i)));
+    }
+  }
+
+  call.setAttributes(attrs);
+  call.setCallingConv(callee.getCallingConv());
+}
+
+/// @brief Plans every site of one function.
+static void planFunction(ReplaceContext &rc, FunctionPlan &plan) {
+  raw_string_ostream report(plan.report);
+  planSites(rc, plan.gvs, report);
+  planSites(rc, plan.funcs, report);
+}
+
+/// @brief Plans every function, on `-gvhide-threads` threads.
+static void planAll(ReplaceContext &rc, ModulePlan &plans) {
+  TimeTraceScope scope("GlobalValueReplacer::plan");
+  auto strategy = hardware_concurrency(Threads);
+  unsigned threads =
+      std::min<size_t>(strategy.compute_thread_count(), plans.size());
+  if (threads <= 1) {
+    for (auto &entry : plans) {
+      planFunction(rc, entry.second);
+    }
+    return;
+  }
+
+  // contiguous chunks, a few per thread to even out function sizes
+  size_t chunks = std::min<size_t>(plans.size(), threads * 4);
+  ThreadPool pool(hardware_concurrency(threads));
+  for (size_t i = 0; i < chunks; ++i) {
+    auto begin = plans.begin() + plans.size() * i / chunks;
+    auto end = plans.begin() + plans.size() * (i + 1) / chunks;
+    pool.async([&rc, begin, end] {
+      for (auto it = begin; it != end; ++it) {
+        planFunction(rc, it->second);
+      }
+    });
+  }
+  pool.wait();
+}
+
 void GlobalValueReplacer::replace(const EncGvsInfo &gvs,
-                                  const EncFunsInfo &funcs) {
-  auto &sub = substitution_.get()->choose();
+                                  const EncFunsInfo &funcs, bool fast) {
+  TimeTraceScope scope("GlobalValueReplacer::replace");
+  for (auto &sub : substitution_->substitutions()) {
+    sub->setSiteMetadata(!fast);
+  }
+  auto rand = seeds_.engine({"choose"});
+  auto &sub = substitution_.get()->choose(rand);
+  auto lightRand = seeds_.engine({"choose", "light"});
+  auto &lightSub = substitution_->choose(lightRand, /*light=*/true);
+  ReplaceContext rc{ctx_,     levels_,        policy_, placement_,
+                    costs_,   batching_,      remarks_, seeds_,
+                    *substitution_, sub,      lightSub};
 
-  for (const auto &gv : gvs) {
-    ReplaceTrait<GlobalVariable>::replace(ctx_, gv, sub);
+  ModulePlan plans;
+  collectPlans(rc, gvs, plans);
+  collectPlans(rc, funcs, plans);
+
+  // analyses are fetched up front: the analysis manager is not thread-safe
+  for (auto &entry : plans) {
+    auto &F = *entry.first;
+    policy_.prepare(F);
+    placement_.prepare(F);
+    costs_.prepare(F, substitution_->substitutions());
+    batching_.prepare(F);
   }
 
-  for (const auto &func : funcs) {
-    ReplaceTrait<Function>::replace(ctx_, func, sub);
+  planAll(rc, plans);
+
+  TimeTraceScope applyScope("GlobalValueReplacer::apply");
+  for (auto &entry : plans) {
+    auto &plan = entry.second;
+    errs() << plan.report;
+    if (!plan.gvs.steps.empty() || !plan.funcs.steps.empty()) {
+      changed_.push_back(entry.first);
+    }
+    applySites(rc, plan.gvs);
+    applySites(rc, plan.funcs);
   }
 }
 
-} // namespace global_value_hide
\ No newline at end of file
+} // namespace global_value_hide
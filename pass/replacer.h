@@ -1,15 +1,39 @@
 #pragma once
 
 #include "algebraic_substitution/substitutionChoose.h"
+#include "batching.h"
+#include "collector.h"
+#include "cost_model.h"
+#include "levels.h"
+#include "placement.h"
+#include "remarks.h"
+#include "policy.h"
 #include "prelude.h"
+#include "seed.h"
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/MapVector.h>
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Config/llvm-config.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/GlobalVariable.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/User.h>
 #include <llvm/Support/Casting.h>
 #include <llvm/Support/raw_ostream.h>
+#if LLVM_VERSION_MAJOR >= 17
+#include <llvm/ADT/bit.h>
+#else
+#include <llvm/Support/MathExtras.h>
+#endif
+#include <iterator>
+#include <map>
+#include <string>
 #include <sys/stat.h>
+#include <tuple>
+#include <vector>
 
 // Forward Declaration AlgebraicSubstitutionInterface from
 // algebraic_substitution/substitution.h
@@ -17,6 +41,77 @@ class AlgebraicSubstitutionInterface;
 
 namespace global_value_hide {
 
+/// @brief State shared by every replacement in a module.
+struct ReplaceContext {
+  llvm::LLVMContext &ctx;               ///< Context for type creation.
+  const FunctionLevels &levels;         ///< Per-function levels.
+  SitePolicy &policy;                   ///< Hot/cold policy.
+  DecryptPlacement &placement;          ///< Reuse and loop hoisting.
+  CostModel &costs;                     ///< Per-site substitution choice.
+  DecryptBatching &batching;            ///< Vector decrypt sequences.
+  SiteRemarks &remarks;                 ///< Per-site remarks.
+  const SeedSource &seeds;              ///< Source of per-site constants.
+  AlgebraicSubstitutionChoose &chooser; ///< Registry of substitutions.
+  AlgebraicSubstitutionInterface
+      &moduleSub; ///< Substitution chosen for the whole module.
+  AlgebraicSubstitutionInterface
+      &lightSub; ///< Light substitution chosen for the whole module.
+};
+
+/// @brief Sites of one hidden value inside one function.
+template <typename T> struct SiteGroup {
+  const EncryptedValue<T> *ev;              ///< Hidden value.
+  llvm::SmallVector<DecryptSite, 4> sites; ///< Its uses, in use-list order.
+};
+
+/// @brief One rewrite of the plan.
+///
+/// Either emits a fresh decrypt sequence before `insertPt`, or, when
+/// `insertPt` is null, reuses the value emitted by step `source`.
+template <typename T> struct SitePlan {
+  const EncryptedValue<T> *ev; ///< Hidden value.
+  DecryptSite site;            ///< Use to rewrite.
+  llvm::Instruction *insertPt; ///< Insertion point of a fresh sequence.
+  AlgebraicSubstitutionInterface *sub; ///< Substitution of the sequence.
+  SiteAction action;                   ///< Action picked by the policy.
+  unsigned source;    ///< Step emitting the value, when reusing.
+  uint64_t constSeed; ///< Seed of the substitution's constants.
+};
+
+/// @brief Sites of one kind of hidden value and their plan.
+template <typename T> struct PlanPart {
+  llvm::SmallVector<SiteGroup<T>, 2> groups; ///< Input of the planning.
+  std::vector<SitePlan<T>> steps;            ///< Output of the planning.
+  std::vector<std::pair<const EncryptedValue<T> *, DecryptSite>>
+      skipped; ///< Sites the policy skipped, kept for remarks.
+};
+
+/// @brief Everything the replacer does to one function.
+///
+/// Global variables are planned and applied before functions, in the order
+/// the encryptor produced them, which keeps the result independent of how
+/// functions are distributed over threads.
+struct FunctionPlan {
+  PlanPart<llvm::GlobalVariable> gvs; ///< Global variable sites.
+  PlanPart<llvm::Function> funcs;     ///< Function call sites.
+  std::string report;                 ///< Buffered policy report.
+
+  template <typename T> PlanPart<T> &part();
+};
+
+template <>
+inline PlanPart<llvm::GlobalVariable> &
+FunctionPlan::part<llvm::GlobalVariable>() {
+  return gvs;
+}
+
+template <> inline PlanPart<llvm::Function> &FunctionPlan::part() {
+  return funcs;
+}
+
+/// @brief Plans of every function with sites, in order of first appearance.
+using ModulePlan = llvm::MapVector<llvm::Function *, FunctionPlan>;
+
 /// @brief A class for replacing global values with encrypted counterparts.
 ///
 /// This class handles the replacement of global variables and functions
@@ -29,6 +124,30 @@ private:
   /// @brief A reference to the LLVM context used for IR modifications.
   llvm::LLVMContext &ctx_;
 
+  /// @brief Per-function obfuscation levels.
+  const FunctionLevels &levels_;
+
+  /// @brief Hot/cold policy deciding how each site is rewritten.
+  SitePolicy &policy_;
+
+  /// @brief Reuse and loop hoisting of decrypted values.
+  DecryptPlacement &placement_;
+
+  /// @brief Per-site, cost-weighted substitution choice.
+  CostModel &costs_;
+
+  /// @brief Batching of the decrypt sequences of one block.
+  DecryptBatching &batching_;
+
+  /// @brief Optimization remarks for every site.
+  SiteRemarks &remarks_;
+
+  /// @brief Source of substitution choices and per-site constants.
+  const SeedSource &seeds_;
+
+  /// @brief Functions at least one site was rewritten in, in module order.
+  llvm::SmallVector<llvm::Function *, 16> changed_;
+
 public:
   /// @brief A unique pointer to the substitution algorithm.
   std::unique_ptr<AlgebraicSubstitutionChoose> substitution_;
@@ -36,7 +155,19 @@ public:
   /// @brief Constructs a GlobalValueReplacer with the given LLVM context.
   ///
   /// @param ctx The LLVM context associated with the current module.
-  GlobalValueReplacer(llvm::LLVMContext &ctx) : ctx_(ctx) {
+  /// @param levels Per-function obfuscation levels.
+  /// @param policy Hot/cold policy deciding how each site is rewritten.
+  /// @param placement Reuse and loop hoisting of decrypted values.
+  /// @param costs Per-site, cost-weighted substitution choice.
+  /// @param batching Batching of the decrypt sequences of one block.
+  /// @param remarks Optimization remarks for every site.
+  /// @param seeds Source of substitution choices and per-site constants.
+  GlobalValueReplacer(llvm::LLVMContext &ctx, const FunctionLevels &levels,
+                      SitePolicy &policy, DecryptPlacement &placement,
+                      CostModel &costs, DecryptBatching &batching,
+                      SiteRemarks &remarks, const SeedSource &seeds)
+      : ctx_(ctx), levels_(levels), policy_(policy), placement_(placement),
+        costs_(costs), batching_(batching), remarks_(remarks), seeds_(seeds) {
     substitution_ = std::make_unique<AlgebraicSubstitutionChoose>();
   };
 
@@ -45,109 +176,582 @@ public:
   /// Iterates through all provided encrypted global variables (gvs) and
   /// functions (funcs), replacing their uses with dynamically decrypted values.
   ///
+  /// Works in two phases. Planning collects the sites of every function,
+  /// asks the policy, the placement stage and the cost model about each one
+  /// and draws its constants; it only reads the IR and runs on
+  /// `-gvhide-threads` threads, one function at a time. Applying the plans
+  /// then emits the sequences serially, merging those of one block into
+  /// vector batches when batching is enabled. The output does not depend on
+  /// the number of threads.
+  ///
   /// @param gvs   Container of encrypted global variable metadata.
   /// @param funcs Container of encrypted function metadata.
-  void replace(const EncGvsInfo &gvs, const EncFunsInfo &funcs);
+  /// @param fast  Leave out the per-site metadata of the substitutions.
+  void replace(const EncGvsInfo &gvs, const EncFunsInfo &funcs,
+               bool fast = false);
+
+  /// @brief Functions replace() rewrote sites in. Decrypt sequences only add
+  /// instructions to existing blocks, so their CFG is unchanged.
+  llvm::ArrayRef<llvm::Function *> changedFunctions() const {
+    return changed_;
+  }
 };
 
+/// @brief Returns the instruction a decrypt sequence for a use is emitted
+/// before.
+///
+/// PHI operands are materialized at the end of the incoming block, every
+/// other use right before its user.
+///
+/// @param U Use of the original value; its user must be an instruction.
+/// @return Insertion point for the decrypt sequence.
+inline llvm::Instruction *decryptInsertionPoint(llvm::Use &U) {
+  if (auto *phi = llvm::dyn_cast<llvm::PHINode>(U.getUser())) {
+    return phi->getIncomingBlock(U)->getTerminator();
+  }
+  return llvm::cast<llvm::Instruction>(U.getUser());
+}
+
+/// @brief Emits the table load and decrypt sequence for one site.
+///
+/// 1. Takes the interned address of the encrypted value's slot.
+/// 2. Loads the encrypted address from the slot; a relative slot holds its
+///    offset from the table instead, added to the table's address as an
+///    integer.
+/// 3. Decrypts it, either with the substitution or, for SiteAction::Cheap,
+///    with a plain subtraction of the key.
+///
+/// @tparam T Type of the original value.
+/// @param IRB Builder positioned at the insertion point.
+/// @param ctx LLVM context for type creation.
+/// @param ev  Metadata with index, key, and GV pointers.
+/// @param sub Substitution used for the decryption.
+/// @param action Action picked by the site policy.
+/// @param rand Engine for the substitution's constants.
+/// @return The decrypted address.
+template <typename T>
+llvm::Value *createDecryptedAddress(llvm::IRBuilder<> &IRB,
+                                    llvm::LLVMContext &ctx,
+                                    const EncryptedValue<T> &ev,
+                                    AlgebraicSubstitutionInterface &sub,
+                                    SiteAction action,
+                                    utils::RandomEngine &rand) {
+  auto encGV = ev.encryptedGV;
+  auto gep = ev.slot;
+  llvm::Value *encrypted;
+  if (encGV->getValueType()->getArrayElementType()->isIntegerTy(32)) {
+    // relative slot: the table address plus the slot is the encrypted
+    // pointer; the sum goes through an integer so that the pointer does not
+    // inherit the table's provenance, which would let alias analysis treat
+    // accesses through it as constant memory
+    auto intPtrTy = IRB.getIntPtrTy(encGV->getParent()->getDataLayout());
+    auto slot = IRB.CreateLoad(llvm::Type::getInt32Ty(ctx), gep);
+    encrypted = IRB.CreateIntToPtr(
+        IRB.CreateAdd(IRB.CreatePtrToInt(encGV, intPtrTy),
+                      IRB.CreateSExt(slot, intPtrTy)),
+        llvm::PointerType::get(llvm::Type::getInt8Ty(ctx), 0),
+        ev.originalValue->getName() + "__encrypted");
+  } else {
+    encrypted =
+        IRB.CreateLoad(llvm::PointerType::get(llvm::Type::getInt8Ty(ctx), 0),
+                       gep, ev.originalValue->getName() + "__encrypted");
+  }
+
+  if (action == SiteAction::Cheap) {
+    return IRB.CreateGEP(llvm::Type::getInt8Ty(ctx), encrypted,
+                         llvm::ConstantExpr::getNeg(ev.encryptionKey),
+                         "plain_dec");
+  }
+  return sub.substitution(IRB, encrypted, ev.encryptionKey, ctx, rand);
+}
+
+/// @brief Emits one vector load and decrypt sequence for several slots of a
+/// table.
+///
+/// Adjacent slots are loaded with a single vector load, others one by one
+/// into the lanes of a vector. The vector is decrypted at once, with the
+/// substitution or, for SiteAction::Cheap, with a plain subtraction of the
+/// per-lane keys.
+///
+/// @param IRB Builder positioned at the insertion point.
+/// @param ctx LLVM context for type creation.
+/// @param table Table holding the slots.
+/// @param indices Slot of every lane, in increasing order.
+/// @param keys Key of every lane.
+/// @param sub Vectorizable substitution used for the decryption.
+/// @param action Action shared by the sites of every lane.
+/// @param rand Engine for the substitution's constants.
+/// @return The decrypted address of every lane.
+llvm::SmallVector<llvm::Value *, 8>
+createDecryptedAddresses(llvm::IRBuilder<> &IRB, llvm::LLVMContext &ctx,
+                         llvm::GlobalVariable &table,
+                         llvm::ArrayRef<size_t> indices,
+                         llvm::ArrayRef<llvm::Constant *> keys,
+                         AlgebraicSubstitutionInterface &sub,
+                         SiteAction action, utils::RandomEngine &rand);
+
 /// @brief Template trait for replacing specific types of encrypted values.
 ///
 /// Provides a generic interface for replacing uses of encrypted globals.
-/// Specializations must implement the static `replace` method.
+/// Specializations must implement the static `collectSites`, `rewrite`,
+/// `decrypt` and `fromAddress` methods; `collectPlans`, `planSites` and
+/// `applySites` drive them.
 ///
 /// @tparam T Type of value to replace (e.g., GlobalVariable, Function).
 template <typename T> struct ReplaceTrait {
-  /// @brief Replaces all uses of an encrypted value with its decrypted form.
+  /// @brief Collects the uses of an encrypted value that will be rewritten.
+  ///
+  /// @param ev Metadata containing the original value, encrypted GV, and key.
+  /// @return Sites in use-list order.
+  static llvm::SmallVector<DecryptSite, 8>
+  collectSites(const EncryptedValue<T> &ev);
+
+  /// @brief Points a site at the decrypted address.
+  ///
+  /// @param ev Metadata containing the original value, encrypted GV, and key.
+  /// @param site Site to rewrite.
+  /// @param decrypted Decrypted address as returned by `decrypt`.
+  static void rewrite(const EncryptedValue<T> &ev, const DecryptSite &site,
+                      llvm::Value *decrypted);
+
+  /// @brief Emits the decrypt sequence for a site.
+  ///
+  /// @param IRB Builder positioned at the insertion point.
+  /// @param ctx LLVM context for type creation.
+  /// @param ev  Metadata containing the original value, encrypted GV, and key.
+  /// @param sub Substitution used for the decryption.
+  /// @param action Action picked by the site policy.
+  /// @param rand Engine for the substitution's constants.
+  /// @return Value `rewrite` expects.
+  static llvm::Value *decrypt(llvm::IRBuilder<> &IRB, llvm::LLVMContext &ctx,
+                              const EncryptedValue<T> &ev,
+                              AlgebraicSubstitutionInterface &sub,
+                              SiteAction action, utils::RandomEngine &rand);
+
+  /// @brief Turns a decrypted address into the value `rewrite` expects.
   ///
-  /// @param ctx LLVM context for IR modifications.
+  /// @param IRB Builder positioned after the address.
   /// @param ev  Metadata containing the original value, encrypted GV, and key.
-  static void replace(llvm::LLVMContext &ctx, const EncryptedValue<T> &ev,
-                      AlgebraicSubstitutionInterface &sub);
+  /// @param address Decrypted address of the value.
+  /// @return Value `rewrite` expects.
+  static llvm::Value *fromAddress(llvm::IRBuilder<> &IRB,
+                                  const EncryptedValue<T> &ev,
+                                  llvm::Value *address);
 };
 
 /// @brief Specialization of ReplaceTrait for GlobalVariable replacement.
 ///
 /// Replaces all uses of a global variable with a GEP-load-decrypt sequence.
-/// Inserts metadata ("obf.md") on the generated GEP instructions for analysis.
 template <> struct ReplaceTrait<llvm::GlobalVariable> {
-  /// @brief Replaces uses of an encrypted global variable.
+  /// @brief Collects every use of an encrypted global variable that
+  /// CollecTrait deems rewritable.
   ///
-  /// For each user of the original GV:
-  /// 1. Generates a GEP to access the encrypted GV's slot.
-  /// 2. Loads the encrypted address from the GV.
-  /// 3. Calls decryptValue to compute the real address.
-  /// 4. Replaces the original GV use with the decrypted address.
-  ///
-  /// @param ctx LLVM context for type creation.
-  /// @param ev  EncryptedGlobalVar metadata with index, key, and GV pointers.
-  static void replace(llvm::LLVMContext &ctx, const EncGv &ev,
-                      AlgebraicSubstitutionInterface &sub) {
-    auto encGV = ev.encryptedGV;
-
-    for (auto user : ev.originalValue->users()) {
-      if (auto *inst = llvm::dyn_cast<llvm::Instruction>(user)) {
-        llvm::IRBuilder<> IRB(inst);
-
-        llvm::Value *indices[] = {
-            llvm::ConstantInt::get(llvm::Type::getInt32Ty(ctx), 0),
-            llvm::ConstantInt::get(llvm::Type::getInt32Ty(ctx), ev.index)};
-        auto gep = IRB.CreateGEP(encGV->getValueType(), encGV, indices);
-        llvm::Value *encrypted = IRB.CreateLoad(
-            llvm::PointerType::get(llvm::Type::getInt8Ty(ctx), 0), gep,
-            ev.originalValue->getName() + "__encrypted");
-        auto gvAddr = sub.substitution(IRB, encrypted, ev.encryptionKey, ctx);
-
-        inst->replaceUsesOfWith(ev.originalValue, gvAddr);
+  /// @param ev EncryptedGlobalVar metadata with index, key, and GV pointers.
+  /// @return Sites in use-list order.
+  static llvm::SmallVector<DecryptSite, 8> collectSites(const EncGv &ev) {
+    llvm::SmallVector<DecryptSite, 8> sites;
+    for (auto &use : ev.originalValue->uses()) {
+      if (CollecTrait<llvm::GlobalVariable>::rewritable(use)) {
+        sites.push_back({&use, decryptInsertionPoint(use)});
       }
     }
+    return sites;
+  }
+
+  /// @brief Replaces the global variable operand with the decrypted address.
+  static void rewrite(const EncGv &ev, const DecryptSite &site,
+                      llvm::Value *decrypted) {
+    site.use->set(decrypted);
+  }
+
+  /// @brief Emits the GEP-load-decrypt sequence for a global variable.
+  static llvm::Value *decrypt(llvm::IRBuilder<> &IRB, llvm::LLVMContext &ctx,
+                              const EncGv &ev,
+                              AlgebraicSubstitutionInterface &sub,
+                              SiteAction action, utils::RandomEngine &rand) {
+    return createDecryptedAddress(IRB, ctx, ev, sub, action, rand);
+  }
+
+  /// @brief The address is used as is.
+  static llvm::Value *fromAddress(llvm::IRBuilder<> &IRB, const EncGv &ev,
+                                  llvm::Value *address) {
+    return address;
   }
 };
 
+/// @brief Carries what the call site could see of its direct callee over to
+/// the now indirect call.
+///
+/// Copies the calling convention and the function attributes that describe
+/// the callee's behaviour (`nounwind`, `noreturn`, memory effects, ...), and,
+/// when the call uses the callee's own type, its return and parameter
+/// attributes. Call-site attributes already present are kept, as are `tail`
+/// and `musttail` markers.
+///
+/// @param call Call, invoke or callbr being rewritten.
+/// @param callee Its original callee.
+void copyCalleeInfo(llvm::CallBase &call, const llvm::Function &callee);
+
 /// @brief Specialization of ReplaceTrait for Function replacement.
 ///
 /// Replaces all call sites of a function with a decrypted function pointer.
 /// Handles bitcasting to ensure correct function type signatures.
 template <> struct ReplaceTrait<llvm::Function> {
-  /// @brief Replaces calls to an encrypted function.
+  /// @brief Collects the calls, invokes and callbrs whose callee is the
+  /// encrypted function.
   ///
-  /// For each call instruction targeting the original function:
-  /// 1. Generates a GEP to access the encrypted function's slot.
-  /// 2. Loads the encrypted function pointer.
-  /// 3. Decrypts and bitcasts the pointer to the correct function type.
-  /// 4. Updates the call's callee to the decrypted function.
+  /// Calls that merely pass the function as an argument are left alone.
   ///
-  /// @param ctx LLVM context for type creation.
-  /// @param ev  EncryptedFunction metadata with index, key, and GV pointers.
-  static void replace(llvm::LLVMContext &ctx, const EncFun &ev,
-                      AlgebraicSubstitutionInterface &sub) {
-    auto encGV = ev.encryptedGV;
-    auto key = ev.encryptionKey;
-
-    llvm::SmallVector<llvm::CallInst *, 8> callsToReplace;
-    for (auto user : ev.originalValue->users()) {
-      if (auto *call = llvm::dyn_cast<llvm::CallInst>(user)) {
-        callsToReplace.push_back(call);
+  /// @param ev EncryptedFunction metadata with index, key, and GV pointers.
+  /// @return Sites in use-list order.
+  static llvm::SmallVector<DecryptSite, 8> collectSites(const EncFun &ev) {
+    llvm::SmallVector<DecryptSite, 8> sites;
+    for (auto &use : ev.originalValue->uses()) {
+      if (CollecTrait<llvm::Function>::rewritable(use)) {
+        sites.push_back({&use, llvm::cast<llvm::CallBase>(use.getUser())});
       }
     }
+    return sites;
+  }
 
-    for (auto call : callsToReplace) {
-      llvm::IRBuilder<> IRB(call);
-      llvm::Value *indices[] = {
-          llvm::ConstantInt::get(llvm::Type::getInt32Ty(ctx), 0),
-          llvm::ConstantInt::get(llvm::Type::getInt32Ty(ctx), ev.index)};
+  /// @brief Updates the call's callee to the decrypted function, keeping
+  /// what the call knew about its callee.
+  static void rewrite(const EncFun &ev, const DecryptSite &site,
+                      llvm::Value *decrypted) {
+    auto *call = llvm::cast<llvm::CallBase>(site.use->getUser());
+    copyCalleeInfo(*call, *ev.originalValue);
+    call->setCalledOperand(decrypted);
+  }
+
+  /// @brief Emits the decrypt sequence and bitcasts the pointer to the
+  /// function's type.
+  static llvm::Value *decrypt(llvm::IRBuilder<> &IRB, llvm::LLVMContext &ctx,
+                              const EncFun &ev,
+                              AlgebraicSubstitutionInterface &sub,
+                              SiteAction action, utils::RandomEngine &rand) {
+    auto decrypted = createDecryptedAddress(IRB, ctx, ev, sub, action, rand);
+    return fromAddress(IRB, ev, decrypted);
+  }
+
+  /// @brief Bitcasts the address to the function's type.
+  static llvm::Value *fromAddress(llvm::IRBuilder<> &IRB, const EncFun &ev,
+                                  llvm::Value *address) {
+    return IRB.CreateBitCast(
+        address, ev.originalValue->getFunctionType()->getPointerTo());
+  }
+};
+
+/// @brief Records an emitted decrypt sequence in the pass statistics.
+///
+/// @param kind Name of the substitution, or "cheap" for a plain subtraction.
+/// @param begin First instruction of the sequence.
+/// @param end Instruction the sequence was emitted before.
+void countSequence(llvm::StringRef kind, llvm::BasicBlock::iterator begin,
+                   llvm::BasicBlock::iterator end);
+
+/// @brief Records an emitted batch in the pass statistics.
+///
+/// @param kind Name of the substitution, or "cheap" for a plain subtraction.
+/// @param sites Number of sites the batch decrypts.
+/// @param begin First instruction of the batch.
+/// @param end Instruction the batch was emitted before.
+void countBatch(llvm::StringRef kind, unsigned sites,
+                llvm::BasicBlock::iterator begin,
+                llvm::BasicBlock::iterator end);
+
+/// @brief Records a site rewritten to an already emitted sequence.
+void countReusedSite();
+
+/// @brief Distributes the sites of encrypted values over function plans.
+///
+/// Sites inside functions at level `off` are left out.
+///
+/// @tparam T Type of value to replace.
+/// @param rc Per-module replacement state.
+/// @param vals Encrypted values, in encryption order.
+/// @param plans Plans to extend.
+template <typename T>
+void collectPlans(ReplaceContext &rc,
+                  const std::vector<EncryptedValue<T>> &vals,
+                  ModulePlan &plans) {
+  for (const auto &ev : vals) {
+    for (const auto &site : ReplaceTrait<T>::collectSites(ev)) {
+      if (!rc.levels.rewrites(*site.use)) {
+        rc.remarks.skipped(*llvm::cast<llvm::Instruction>(site.use->getUser()),
+                           *ev.originalValue,
+                           "function is annotated gvhide=off");
+        continue;
+      }
+      auto &groups = plans[site.at->getFunction()].template part<T>().groups;
+      if (groups.empty() || groups.back().ev != &ev) {
+        groups.push_back({&ev, {}});
+      }
+      groups.back().sites.push_back(site);
+    }
+  }
+}
 
-      auto gep = IRB.CreateInBoundsGEP(encGV->getValueType(), encGV, indices);
-      llvm::Value *encrypted =
-          IRB.CreateLoad(llvm::PointerType::get(llvm::Type::getInt8Ty(ctx), 0),
-                         gep, ev.originalValue->getName() + "_encrypted");
+/// @brief Plans the sites of one kind of value in one function.
+///
+/// Each site is placed and shaped by the hot/cold policy; with the placement
+/// stage enabled, a dominating sequence of the same value is reused instead
+/// of planning a new one. The substitution of a site comes from the cost
+/// model, restricted to light substitutions in functions at level `light`.
+///
+/// Each site draws its substitution and constants from an engine keyed by
+/// the symbol, its function and its index in that function, so edits to one
+/// function do not change the constants of another.
+///
+/// Only reads the IR; the function must have been prepared.
+///
+/// @tparam T Type of value to replace.
+/// @param rc Per-module replacement state.
+/// @param part Sites to plan; receives the steps.
+/// @param report Stream for the policy report.
+template <typename T>
+void planSites(ReplaceContext &rc, PlanPart<T> &part,
+               llvm::raw_ostream &report) {
+  for (auto &group : part.groups) {
+    const auto &ev = *group.ev;
+    rc.placement.order(group.sites);
 
-      auto decrypted = sub.substitution(IRB, encrypted, key, ctx);
-      auto funcPtr = IRB.CreateBitCast(
-          decrypted, ev.originalValue->getFunctionType()->getPointerTo());
+    uint64_t index = 0;
+    for (const auto &site : group.sites) {
+      auto &F = *site.at->getFunction();
+      auto siteIndex = index++;
 
-      call->setCalledOperand(funcPtr);
+      auto decision = rc.policy.decide(*site.at);
+      rc.policy.report(report, *site.at, *ev.originalValue, decision);
+      if (decision.action == SiteAction::Skip) {
+        if (rc.remarks.enabled()) {
+          part.skipped.push_back({&ev, site});
+        }
+        continue;
+      }
+
+      SitePlan<T> step{&ev,    site, nullptr, nullptr, decision.action,
+                       static_cast<unsigned>(part.steps.size()), 0};
+      if (auto source =
+              rc.placement.lookup(*ev.originalValue, *decision.insertPt)) {
+        step.source = *source;
+      } else {
+        step.insertPt = rc.placement.hoist(*decision.insertPt);
+        auto rand = rc.seeds.engine(
+            {"site", ev.originalValue->getName(), F.getName()}, siteIndex);
+        bool light = rc.levels.level(F) == HideLevel::Light;
+        auto &moduleSub = light ? rc.lightSub : rc.moduleSub;
+        // drawn first so that the cost model can price the expression the
+        // site will emit
+        step.constSeed = rand.getUint64();
+        step.sub = decision.action == SiteAction::Cheap
+                       ? &moduleSub
+                       : &rc.costs.select(*step.insertPt, rc.chooser,
+                                          moduleSub, rand, step.constSeed,
+                                          light);
+        rc.placement.record(*ev.originalValue, *step.insertPt, step.source);
+      }
+      part.steps.push_back(step);
     }
   }
+  part.groups.clear();
+}
+
+/// @brief Fresh steps of one block decrypted by a single vector sequence.
+template <typename T> struct DecryptBatch {
+  llvm::SmallVector<const EncryptedValue<T> *, 4>
+      lanes;                          ///< Hidden value of each lane.
+  llvm::SmallVector<unsigned, 8> steps; ///< Steps the batch decrypts.
+  llvm::Instruction *insertPt = nullptr; ///< Earliest insertion point.
 };
 
+/// @brief Groups the fresh steps of a plan into batches.
+///
+/// Steps join a batch when they are emitted into the same block, load from
+/// the same table and decrypt with the same vectorizable substitution, or
+/// all with the plain subtraction. Steps of a value already in the batch
+/// share its lane. Lanes are sorted by slot and cut down to a power of two;
+/// a batch is emitted before the earliest insertion point of its steps.
+///
+/// @tparam T Type of value to replace.
+/// @param rc Per-module replacement state.
+/// @param part Planned steps of one function.
+/// @param batchOf Receives the batch of every step, or -1.
+/// @return Batches with at least two lanes.
+template <typename T>
+std::vector<DecryptBatch<T>> formBatches(ReplaceContext &rc,
+                                         const PlanPart<T> &part,
+                                         std::vector<int> &batchOf) {
+  batchOf.assign(part.steps.size(), -1);
+  if (part.steps.empty()) {
+    return {};
+  }
+  unsigned lanes =
+      rc.batching.lanes(*part.steps.front().site.at->getFunction());
+  if (lanes < 2) {
+    return {};
+  }
+
+  using BatchKey =
+      std::tuple<llvm::BasicBlock *, llvm::GlobalVariable *,
+                 AlgebraicSubstitutionInterface *>;
+  std::vector<DecryptBatch<T>> batches;
+  std::map<BatchKey, unsigned> open;
+  for (unsigned i = 0; i < part.steps.size(); ++i) {
+    const auto &step = part.steps[i];
+    bool cheap = step.action == SiteAction::Cheap;
+    if (!step.insertPt || (!cheap && !step.sub->vectorizable())) {
+      continue;
+    }
+
+    BatchKey key{step.insertPt->getParent(), step.ev->encryptedGV,
+                 cheap ? nullptr : step.sub};
+    auto [it, inserted] = open.try_emplace(key, batches.size());
+    if (inserted) {
+      batches.emplace_back();
+    }
+    if (!llvm::is_contained(batches[it->second].lanes, step.ev)) {
+      if (batches[it->second].lanes.size() == lanes) {
+        it->second = batches.size();
+        batches.emplace_back();
+      }
+      batches[it->second].lanes.push_back(step.ev);
+    }
+
+    batches[it->second].steps.push_back(i);
+  }
+
+  // vectors of a power of two lanes map onto registers; the lanes of the
+  // highest slots that do not fit are decrypted on their own
+  std::vector<DecryptBatch<T>> result;
+  for (auto &batch : batches) {
+    if (batch.lanes.size() < 2) {
+      continue;
+    }
+    llvm::sort(batch.lanes,
+               [](auto *a, auto *b) { return a->index < b->index; });
+#if LLVM_VERSION_MAJOR >= 17
+    batch.lanes.resize(llvm::bit_floor(batch.lanes.size()));
+#else
+    batch.lanes.resize(llvm::PowerOf2Floor(batch.lanes.size()));
+#endif
+    llvm::erase_if(batch.steps, [&](unsigned step) {
+      return !llvm::is_contained(batch.lanes, part.steps[step].ev);
+    });
+    batch.insertPt = part.steps[batch.steps.front()].insertPt;
+    for (auto step : batch.steps) {
+      batchOf[step] = result.size();
+      auto *at = part.steps[step].insertPt;
+      if (at->comesBefore(batch.insertPt)) {
+        batch.insertPt = at;
+      }
+    }
+    result.push_back(std::move(batch));
+  }
+  return result;
+}
+
+/// @brief Emits the vector sequence of a batch.
+///
+/// @tparam T Type of value to replace.
+/// @param rc Per-module replacement state.
+/// @param IRB Builder to emit with.
+/// @param part Planned steps the batch belongs to.
+/// @param batch Batch to emit.
+/// @return Value `rewrite` expects for every lane.
+template <typename T>
+llvm::SmallVector<llvm::Value *, 8>
+emitBatch(ReplaceContext &rc, llvm::IRBuilder<> &IRB, const PlanPart<T> &part,
+          const DecryptBatch<T> &batch) {
+  const auto &first = part.steps[batch.steps.front()];
+  auto *prev = batch.insertPt->getPrevNode();
+  IRB.SetInsertPoint(batch.insertPt);
+  utils::RandomEngine rand(first.constSeed);
+
+  llvm::SmallVector<size_t, 8> indices;
+  llvm::SmallVector<llvm::Constant *, 8> keys;
+  for (auto *ev : batch.lanes) {
+    indices.push_back(ev->index);
+    keys.push_back(ev->encryptionKey);
+  }
+  auto addresses =
+      createDecryptedAddresses(IRB, rc.ctx, *first.ev->encryptedGV, indices,
+                               keys, *first.sub, first.action, rand);
+  for (size_t i = 0; i < addresses.size(); ++i) {
+    addresses[i] =
+        ReplaceTrait<T>::fromAddress(IRB, *batch.lanes[i], addresses[i]);
+  }
+
+  auto kind = first.action == SiteAction::Cheap ? "cheap" : first.sub->name();
+  auto begin = prev ? std::next(prev->getIterator())
+                    : batch.insertPt->getParent()->begin();
+  countBatch(kind, batch.steps.size(), begin, batch.insertPt->getIterator());
+  for (auto i : batch.steps) {
+    const auto &step = part.steps[i];
+    rc.remarks.hidden(*llvm::cast<llvm::Instruction>(step.site.use->getUser()),
+                      *step.ev->originalValue, kind,
+                      SitePolicy::actionName(step.action), begin,
+                      batch.insertPt->getIterator(), batch.steps.size());
+  }
+  return addresses;
+}
+
+/// @brief Emits the decrypt sequences of a plan and rewrites its sites.
+///
+/// Sites are rewritten through the uses collected in the plan, so no user's
+/// operand list is scanned, and one builder serves every sequence.
+///
+/// @tparam T Type of value to replace.
+/// @param rc Per-module replacement state.
+/// @param part Planned steps.
+template <typename T>
+void applySites(ReplaceContext &rc, const PlanPart<T> &part) {
+  std::vector<int> batchOf;
+  auto batches = formBatches(rc, part, batchOf);
+  std::vector<llvm::SmallVector<llvm::Value *, 8>> batchValues(
+      batches.size());
+
+  for (const auto &[ev, site] : part.skipped) {
+    rc.remarks.skipped(*llvm::cast<llvm::Instruction>(site.use->getUser()),
+                       *ev->originalValue,
+                       "hot site, skipped by -gvhide-hot-action=skip");
+  }
+
+  llvm::IRBuilder<> IRB(rc.ctx);
+  std::vector<llvm::Value *> values;
+  values.reserve(part.steps.size());
+  for (unsigned i = 0; i < part.steps.size(); ++i) {
+    const auto &step = part.steps[i];
+    auto *user = llvm::cast<llvm::Instruction>(step.site.use->getUser());
+    llvm::Value *decrypted;
+    if (batchOf[i] >= 0) {
+      auto &batch = batches[batchOf[i]];
+      auto &lanes = batchValues[batchOf[i]];
+      if (lanes.empty()) {
+        lanes = emitBatch(rc, IRB, part, batch);
+      }
+      decrypted = lanes[llvm::find(batch.lanes, step.ev) - batch.lanes.begin()];
+    } else if (step.insertPt) {
+      auto *prev = step.insertPt->getPrevNode();
+      IRB.SetInsertPoint(step.insertPt);
+      utils::RandomEngine rand(step.constSeed);
+      decrypted = ReplaceTrait<T>::decrypt(IRB, rc.ctx, *step.ev, *step.sub,
+                                           step.action, rand);
+      auto kind =
+          step.action == SiteAction::Cheap ? "cheap" : step.sub->name();
+      auto begin = prev ? std::next(prev->getIterator())
+                        : step.insertPt->getParent()->begin();
+      countSequence(kind, begin, step.insertPt->getIterator());
+      rc.remarks.hidden(*user, *step.ev->originalValue, kind,
+                        SitePolicy::actionName(step.action), begin,
+                        step.insertPt->getIterator());
+    } else {
+      decrypted = values[step.source];
+      countReusedSite();
+      rc.remarks.reused(*user, *step.ev->originalValue);
+    }
+    values.push_back(decrypted);
+    ReplaceTrait<T>::rewrite(*step.ev, step.site, decrypted);
+  }
+}
+
 }; // namespace global_value_hide
\ No newline at end of file
@@ -0,0 +1,47 @@
+#include "seed.h"
+#include <cstdlib>
+#include <llvm/Support/CommandLine.h>
+#include <random>
+
+using namespace llvm;
+
+static cl::opt<uint64_t>
+    Seed("gvhide-seed",
+         cl::desc("Base seed for keys, constants and substitution choices "
+                  "(default: GVHIDE_SEED or a random seed)"));
+
+namespace global_value_hide {
+
+/// @brief Resolves the base seed from the command line, the environment or
+/// the system entropy source.
+static uint64_t defaultSeed() {
+  if (Seed.getNumOccurrences()) {
+    return Seed;
+  }
+
+  uint64_t value;
+  if (auto *env = std::getenv("GVHIDE_SEED");
+      env && !StringRef(env).getAsInteger(0, value)) {
+    return value;
+  }
+
+  std::random_device device;
+  return (static_cast<uint64_t>(device()) << 32) | device();
+}
+
+SeedSource::SeedSource(const Module &M, std::optional<uint64_t> seed) {
+  moduleSeed_ = utils::hashCombine(seed ? *seed : defaultSeed(),
+                                   M.getModuleIdentifier());
+}
+
+utils::RandomEngine
+SeedSource::engine(std::initializer_list<StringRef> tags,
+                   uint64_t index) const {
+  uint64_t hash = moduleSeed_;
+  for (auto tag : tags) {
+    hash = utils::hashCombine(hash, std::string_view(tag.data(), tag.size()));
+  }
+  return utils::RandomEngine(utils::hashCombine(hash, index));
+}
+
+} // namespace global_value_hide
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "utils/utils.h"
+#include <cstdint>
+#include <initializer_list>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/Module.h>
+#include <optional>
+
+namespace global_value_hide {
+
+/// @brief Source of every random draw the pass makes on a module.
+///
+/// All keys, constants and substitution choices come from engines derived
+/// from one base seed plus stable identifiers (module ID, symbol name,
+/// enclosing function, use index). Identical input and seed therefore give
+/// bit-identical output, and editing one function leaves the draws made for
+/// every other function unchanged.
+///
+/// The base seed is, in order of precedence: the `seed` pass parameter
+/// (`global-value-hide<seed=N>`), `-gvhide-seed=N`, the `GVHIDE_SEED`
+/// environment variable, or a fresh `std::random_device` value.
+class SeedSource {
+private:
+  uint64_t moduleSeed_; ///< Base seed mixed with the module ID.
+
+public:
+  /// @brief Resolves the base seed for a module.
+  /// @param M Module being transformed.
+  /// @param seed Seed given as a pass parameter, if any.
+  SeedSource(const llvm::Module &M, std::optional<uint64_t> seed);
+
+  /// @brief Derives an engine for one purpose.
+  /// @param tags Stable identifiers of the draw, e.g. {"key", symbol name}.
+  /// @param index Extra discriminator, e.g. the use index.
+  /// @return Engine whose sequence only depends on the seed and the inputs.
+  utils::RandomEngine engine(std::initializer_list<llvm::StringRef> tags,
+                             uint64_t index = 0) const;
+};
+
+} // namespace global_value_hide
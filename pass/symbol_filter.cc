@@ -0,0 +1,242 @@
+#include "symbol_filter.h"
+#include <algorithm>
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/IR/Attributes.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalObject.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+using namespace llvm;
+
+static cl::opt<std::string>
+    PolicyFile("gvhide-policy",
+               cl::desc("File of allow/deny rules selecting the symbols to "
+                        "hide"),
+               cl::value_desc("filename"));
+
+static cl::list<std::string>
+    PolicyRules("gvhide-rule",
+                cl::desc("Allow/deny rule, applied after -gvhide-policy"));
+
+namespace global_value_hide {
+
+/// @brief IR spelling of every linkage type, indexed by LinkageTypes.
+static const StringRef LINKAGE_NAMES[] = {
+    "external", "available_externally", "linkonce", "linkonce_odr",
+    "weak",     "weak_odr",             "appending", "internal",
+    "private",  "extern_weak",          "common"};
+
+Error PatternIndex::add(StringRef pattern, unsigned rule) {
+  if (pattern.size() >= 2 && pattern.front() == '/' && pattern.back() == '/') {
+    auto regex = std::make_unique<Regex>(pattern.drop_front().drop_back());
+    std::string error;
+    if (!regex->isValid(error)) {
+      return createStringError(inconvertibleErrorCode(),
+                               "invalid regex '" + pattern + "': " + error);
+    }
+    regexes_.emplace_back(rule, std::move(regex));
+    return Error::success();
+  }
+
+  auto isMeta = [](char c) {
+    return c == '*' || c == '?' || c == '[' || c == '\\';
+  };
+  if (llvm::none_of(pattern, isMeta)) {
+    exact_.try_emplace(pattern, rule);
+    return Error::success();
+  }
+
+  auto stem = pattern.drop_back();
+  if (pattern.back() == '*' && llvm::none_of(stem, isMeta)) {
+    if (prefixes_.try_emplace(stem, rule).second &&
+        !llvm::is_contained(prefixLengths_, stem.size())) {
+      prefixLengths_.push_back(stem.size());
+    }
+    return Error::success();
+  }
+
+  auto glob = GlobPattern::create(pattern);
+  if (!glob) {
+    return glob.takeError();
+  }
+  globs_.emplace_back(rule, std::move(*glob));
+  return Error::success();
+}
+
+unsigned PatternIndex::match(StringRef value, unsigned best) const {
+  if (auto it = exact_.find(value); it != exact_.end()) {
+    best = std::min(best, it->second);
+  }
+
+  for (auto length : prefixLengths_) {
+    if (length <= value.size()) {
+      if (auto it = prefixes_.find(value.take_front(length));
+          it != prefixes_.end()) {
+        best = std::min(best, it->second);
+      }
+    }
+  }
+
+  // rules are added in order, so stop at the first one that cannot win
+  for (auto &[rule, glob] : globs_) {
+    if (rule >= best) {
+      break;
+    }
+    if (glob.match(value)) {
+      best = rule;
+      break;
+    }
+  }
+  for (auto &[rule, regex] : regexes_) {
+    if (rule >= best) {
+      break;
+    }
+    if (regex->match(value)) {
+      best = rule;
+      break;
+    }
+  }
+  return best;
+}
+
+Error SymbolFilter::addRule(StringRef line) {
+  line = line.split('#').first.trim();
+  if (line.empty()) {
+    return Error::success();
+  }
+
+  auto [action, selector] = line.split(' ');
+  selector = selector.trim();
+  if (action == "default") {
+    if (selector != "allow" && selector != "deny") {
+      return createStringError(inconvertibleErrorCode(),
+                               "invalid default '" + selector + "'");
+    }
+    defaultAllow_ = selector == "allow";
+    return Error::success();
+  }
+  if (action != "allow" && action != "deny") {
+    return createStringError(inconvertibleErrorCode(),
+                             "invalid action '" + action + "'");
+  }
+
+  unsigned rule = allow_.size();
+  allow_.push_back(action == "allow");
+
+  auto [kind, pattern] = selector.split(':');
+  if (kind == "name") {
+    return names_.add(pattern, rule);
+  }
+  if (kind == "section") {
+    return sections_.add(pattern, rule);
+  }
+  if (kind == "annotate") {
+    hasAnnotateRules_ = true;
+    return annotates_.add(pattern, rule);
+  }
+  if (kind == "attr") {
+    attrs_.try_emplace(pattern, rule);
+    return Error::success();
+  }
+  if (kind == "linkage") {
+    PatternIndex linkage;
+    if (auto err = linkage.add(pattern, rule)) {
+      return err;
+    }
+    for (size_t i = 0; i < NUM_LINKAGES; ++i) {
+      if (linkage.match(LINKAGE_NAMES[i], NO_RULE) == rule) {
+        linkages_[i] = std::min(linkages_[i], rule);
+      }
+    }
+    return Error::success();
+  }
+  return createStringError(inconvertibleErrorCode(),
+                           "invalid selector '" + selector + "'");
+}
+
+Error SymbolFilter::load(const Module &M, StringRef rules) {
+  SmallVector<StringRef, 16> lines;
+  rules.split(lines, '\n');
+  for (auto line : lines) {
+    if (auto err = addRule(line)) {
+      return err;
+    }
+  }
+
+  if (hasAnnotateRules_) {
+    annotations_ = collectAnnotations(M);
+  }
+  return Error::success();
+}
+
+SymbolFilter::SymbolFilter(const Module &M) : SymbolFilter() {
+  std::string rules;
+  if (!PolicyFile.empty()) {
+    auto buffer = MemoryBuffer::getFile(PolicyFile);
+    if (!buffer) {
+      // a user error, not a crash: report it and hide nothing
+      M.getContext().emitError("gvhide: cannot read " + Twine(PolicyFile) +
+                               ": " + buffer.getError().message());
+      defaultAllow_ = false;
+      return;
+    }
+    rules = (*buffer)->getBuffer().str();
+  }
+  for (auto &rule : PolicyRules) {
+    rules += "\n" + rule;
+  }
+
+  if (auto err = load(M, rules)) {
+    M.getContext().emitError("gvhide: invalid policy: " +
+                             Twine(toString(std::move(err))));
+    *this = SymbolFilter();
+    defaultAllow_ = false;
+  }
+}
+
+Expected<std::unique_ptr<SymbolFilter>>
+SymbolFilter::create(const Module &M, StringRef rules) {
+  std::unique_ptr<SymbolFilter> filter(new SymbolFilter());
+  if (auto err = filter->load(M, rules)) {
+    return err;
+  }
+  return filter;
+}
+
+bool SymbolFilter::admits(const GlobalValue &GV) const {
+  if (allow_.empty()) {
+    return defaultAllow_;
+  }
+
+  unsigned best = names_.match(GV.getName(), NO_RULE);
+  best = std::min(best, linkages_[GV.getLinkage()]);
+
+  if (auto *GO = dyn_cast<GlobalObject>(&GV); GO && GO->hasSection()) {
+    best = sections_.match(GO->getSection(), best);
+  }
+
+  if (hasAnnotateRules_) {
+    if (auto it = annotations_.find(&GV); it != annotations_.end()) {
+      for (auto annotation : it->second) {
+        best = annotates_.match(annotation, best);
+      }
+    }
+  }
+
+  if (auto *F = dyn_cast<Function>(&GV); F && !attrs_.empty()) {
+    for (auto &attr : F->getAttributes().getFnAttrs()) {
+      auto name = attr.isStringAttribute()
+                      ? attr.getKindAsString()
+                      : Attribute::getNameFromAttrKind(attr.getKindAsEnum());
+      if (auto it = attrs_.find(name); it != attrs_.end()) {
+        best = std::min(best, it->second);
+      }
+    }
+  }
+
+  return best == NO_RULE ? defaultAllow_ : allow_[best];
+}
+
+} // namespace global_value_hide
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "annotations.h"
+#include <array>
+#include <climits>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/GlobalValue.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/GlobPattern.h>
+#include <llvm/Support/Regex.h>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace global_value_hide {
+
+/// @brief Precompiled index of name patterns.
+///
+/// Plain names and `prefix*` globs are answered by hash lookups; only other
+/// globs and regular expressions are matched one by one, and only while they
+/// can still beat the best rule found so far.
+class PatternIndex {
+private:
+  llvm::StringMap<unsigned> exact_;    ///< Plain names.
+  llvm::StringMap<unsigned> prefixes_; ///< `prefix*` globs, by prefix.
+  llvm::SmallVector<size_t, 4> prefixLengths_; ///< Distinct prefix lengths.
+  std::vector<std::pair<unsigned, llvm::GlobPattern>> globs_; ///< Other globs.
+  std::vector<std::pair<unsigned, std::unique_ptr<llvm::Regex>>>
+      regexes_; ///< `/regex/` patterns.
+
+public:
+  /// @brief Adds a pattern.
+  /// @param pattern Glob, or regular expression enclosed in slashes.
+  /// @param rule Index of the rule the pattern belongs to.
+  /// @return Error if the pattern does not compile.
+  llvm::Error add(llvm::StringRef pattern, unsigned rule);
+
+  /// @brief Finds the first rule matching a value.
+  /// @param value String to match.
+  /// @param best Index of the best rule found so far.
+  /// @return The smaller of best and the first matching rule index.
+  unsigned match(llvm::StringRef value, unsigned best) const;
+};
+
+/// @brief Allowlist/denylist of the symbols to hide.
+///
+/// Rules come from the file given with `-gvhide-policy` and from
+/// `-gvhide-rule` options, one rule per line:
+///
+///     # comment
+///     default allow|deny
+///     allow|deny name:<pattern>
+///     allow|deny section:<pattern>
+///     allow|deny linkage:<pattern>
+///     allow|deny annotate:<pattern>
+///     allow|deny attr:<attribute name>
+///
+/// Patterns are globs, or regular expressions enclosed in slashes
+/// (`name:/^secret_[0-9]+$/`). `annotate` matches the strings of
+/// `__attribute__((annotate(...)))`, `attr` matches function attributes such
+/// as `noinline`. The first matching rule decides; symbols matching no rule
+/// get the default, which is `allow`.
+class SymbolFilter {
+private:
+  static constexpr unsigned NO_RULE = UINT_MAX;
+  static constexpr size_t NUM_LINKAGES =
+      llvm::GlobalValue::CommonLinkage + 1;
+
+  std::vector<bool> allow_; ///< Action of each rule.
+  bool defaultAllow_ = true; ///< Action when no rule matches.
+  PatternIndex names_;       ///< `name:` rules.
+  PatternIndex sections_;    ///< `section:` rules.
+  PatternIndex annotates_;   ///< `annotate:` rules.
+  llvm::StringMap<unsigned> attrs_; ///< `attr:` rules.
+  std::array<unsigned, NUM_LINKAGES> linkages_; ///< `linkage:` rules.
+  AnnotationMap annotations_; ///< Annotations of the module.
+  bool hasAnnotateRules_ = false;
+
+  /// @brief Parses one rule line.
+  llvm::Error addRule(llvm::StringRef line);
+
+  /// @brief Parses rule text and indexes the module's annotations.
+  llvm::Error load(const llvm::Module &M, llvm::StringRef rules);
+
+public:
+  /// @brief Builds the filter for a module from the command line options.
+  /// @param M Module whose symbols are filtered.
+  explicit SymbolFilter(const llvm::Module &M);
+
+  /// @brief Builds a filter from rule text.
+  /// @param M Module whose symbols are filtered.
+  /// @param rules Rules, one per line.
+  /// @return The filter, or the first parse error.
+  static llvm::Expected<std::unique_ptr<SymbolFilter>>
+  create(const llvm::Module &M, llvm::StringRef rules);
+
+  /// @brief Checks whether a symbol may be hidden.
+  /// @param GV Global variable or function.
+  /// @return true if the symbol should be hidden.
+  bool admits(const llvm::GlobalValue &GV) const;
+
+private:
+  SymbolFilter() { linkages_.fill(NO_RULE); }
+};
+
+} // namespace global_value_hide
@@ -0,0 +1,106 @@
+; Exercises every kind of decrypt site: loads, stores and address escapes of
+; globals, direct and indirect calls, uses in PHIs, in a loop and several in
+; one block. Prints values that only come out right when every decrypted
+; address is the original one.
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+@counter = dso_local global i64 0
+@a = dso_local global i64 1
+@b = dso_local global i64 2
+@c = dso_local global i64 3
+@d = dso_local global i64 4
+@table = dso_local global [8 x i32] [i32 0, i32 7, i32 4, i32 1, i32 8, i32 5, i32 2, i32 9]
+@name = private unnamed_addr constant [6 x i8] c"hello\00"
+@callback = dso_local global ptr @twice
+@fmt.sum = private unnamed_addr constant [9 x i8] c"sum=%ld\0A\00"
+@fmt.table = private unnamed_addr constant [11 x i8] c"table=%ld\0A\00"
+@fmt.calls = private unnamed_addr constant [11 x i8] c"calls=%ld\0A\00"
+@fmt.str = private unnamed_addr constant [8 x i8] c"str=%s\0A\00"
+
+declare i32 @printf(ptr, ...)
+
+define internal i64 @twice(i64 %x) {
+  %r = shl i64 %x, 1
+  ret i64 %r
+}
+
+define dso_local i64 @bump(i64 %x) {
+  %old = load i64, ptr @counter
+  %new = add i64 %old, %x
+  store i64 %new, ptr @counter
+  ret i64 %new
+}
+
+; four globals loaded in one block
+define dso_local i64 @sum() {
+  %va = load i64, ptr @a
+  %vb = load i64, ptr @b
+  %vc = load i64, ptr @c
+  %vd = load i64, ptr @d
+  %s1 = add i64 %va, %vb
+  %s2 = add i64 %s1, %vc
+  %s3 = add i64 %s2, %vd
+  ret i64 %s3
+}
+
+; the table in a loop, and the same global used again after it
+define dso_local i64 @walk(i64 %n) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %acc = phi i64 [ 0, %entry ], [ %acc.next, %loop ]
+  %idx = and i64 %i, 7
+  %p = getelementptr [8 x i32], ptr @table, i64 0, i64 %idx
+  %v = load i32, ptr %p
+  %v64 = zext i32 %v to i64
+  %mul = mul i64 %acc, 3
+  %acc.next = add i64 %mul, %v64
+  %i.next = add i64 %i, 1
+  %done = icmp eq i64 %i.next, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  %first = load i32, ptr @table
+  %first64 = zext i32 %first to i64
+  %r = add i64 %acc.next, %first64
+  ret i64 %r
+}
+
+; a global picked by a PHI, then stored through
+define dso_local void @pick(i1 %cond) {
+entry:
+  br i1 %cond, label %then, label %join
+
+then:
+  br label %join
+
+join:
+  %dst = phi ptr [ @c, %then ], [ @d, %entry ]
+  store i64 10, ptr %dst
+  ret void
+}
+
+define dso_local i32 @main() {
+  %s0 = call i64 @sum()
+  call void @pick(i1 true)
+  call void @pick(i1 false)
+  %s1 = call i64 @sum()
+  %total = add i64 %s0, %s1
+  call i32 (ptr, ...) @printf(ptr @fmt.sum, i64 %total)
+
+  %w = call i64 @walk(i64 20)
+  call i32 (ptr, ...) @printf(ptr @fmt.table, i64 %w)
+
+  %cb = load ptr, ptr @callback
+  %x = call i64 %cb(i64 21)
+  %y = call i64 @bump(i64 %x)
+  %z = call i64 @bump(i64 %y)
+  call i32 (ptr, ...) @printf(ptr @fmt.calls, i64 %z)
+
+  call i32 (ptr, ...) @printf(ptr @fmt.str, ptr @name)
+  ret i32 0
+}
@@ -0,0 +1,28 @@
+; The asm barrier pins values in registers only: it neither reads nor writes
+; memory, so -O2 still removes the second load of %p around a decrypt site.
+
+; RUN: %gvopt -passes='global-value-hide<seed=1>' -gvhide-substitution=sub1 %s -S | FileCheck %s
+; RUN: %gvopt -passes='global-value-hide<seed=1>,default<O2>' -gvhide-substitution=sub1 %s -S | FileCheck %s --check-prefix=O2
+
+; CHECK-LABEL: define i32 @f(
+; CHECK:       call i64 asm "", "=r,0"(i64 {{.*}}) #[[ATTR:[0-9]+]]
+; CHECK:       attributes #[[ATTR]] = { nounwind {{readnone|memory\(none\)}} }
+
+; O2-LABEL:    define i32 @f(
+; O2:          load i32, ptr %p
+; O2-NOT:      load i32, ptr %p
+; O2:          ret i32
+
+target triple = "x86_64-pc-linux-gnu"
+
+@g = global i32 1
+
+define i32 @f(ptr %p) {
+entry:
+  %a = load i32, ptr %p
+  %b = load i32, ptr @g
+  %c = load i32, ptr %p
+  %s = add i32 %a, %b
+  %t = add i32 %s, %c
+  ret i32 %t
+}
@@ -0,0 +1,18 @@
+; An unknown level in user source is a plain error naming the function, not
+; a compiler crash.
+
+; RUN: not %gvopt -passes=global-value-hide %s -disable-output 2>&1 | FileCheck %s
+
+; CHECK:     error: gvhide: unknown level 'fast' on function 'f'
+; CHECK-NOT: PLEASE submit a bug report
+
+@g = global i32 1
+@.level = private unnamed_addr constant [12 x i8] c"gvhide=fast\00", section "llvm.metadata"
+@.file = private unnamed_addr constant [9 x i8] c"levels.c\00", section "llvm.metadata"
+@llvm.global.annotations = appending global [1 x { ptr, ptr, ptr, i32, ptr }] [{ ptr, ptr, ptr, i32, ptr } { ptr @f, ptr @.level, ptr @.file, i32 1, ptr null }], section "llvm.metadata"
+
+define i32 @f() {
+entry:
+  %v = load i32, ptr @g
+  ret i32 %v
+}
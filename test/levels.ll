@@ -0,0 +1,102 @@
+; Function levels: @off is left untouched and its global only used there gets
+; no slot, @light only uses sub2, and @full decrypts correctly whatever
+; substitution each of its sites draws.
+; REQUIRES: x86_64-host
+
+; RUN: %gvopt -passes='global-value-hide<seed=1>' %s -S -o %t.1.ll
+; RUN: FileCheck %s < %t.1.ll
+; RUN: %gvopt -passes='global-value-hide<seed=2>' %s -S -o %t.2.ll
+; RUN: FileCheck %s < %t.2.ll
+; RUN: %gvopt -passes='global-value-hide<seed=3>' %s -S -o %t.3.ll
+; RUN: FileCheck %s < %t.3.ll
+
+; RUN: %lli %s | FileCheck %s --check-prefix=OUT
+; RUN: %lli %t.1.ll | FileCheck %s --check-prefix=OUT
+; RUN: %lli %t.2.ll | FileCheck %s --check-prefix=OUT
+; RUN: %lli %t.3.ll | FileCheck %s --check-prefix=OUT
+; RUN: %gvopt -passes='global-value-hide<seed=1>,default<O2>' %s -o %t.1.o2.bc
+; RUN: %lli %t.1.o2.bc | FileCheck %s --check-prefix=OUT
+; RUN: %gvopt -passes='global-value-hide<seed=2>,default<O2>' %s -o %t.2.o2.bc
+; RUN: %lli %t.2.o2.bc | FileCheck %s --check-prefix=OUT
+; RUN: %gvopt -passes='global-value-hide<seed=3>,default<O2>' %s -o %t.3.o2.bc
+; RUN: %lli %t.3.o2.bc | FileCheck %s --check-prefix=OUT
+; RUN: %gvopt -passes='global-value-hide<seed=4>,default<O2>' %s -o %t.4.o2.bc
+; RUN: %lli %t.4.o2.bc | FileCheck %s --check-prefix=OUT
+
+; OUT: off=6 light=3 full=53
+
+; CHECK-NOT:   ptr @only_off, i64
+; CHECK-LABEL: define i32 @off(
+; CHECK-NEXT:  entry:
+; CHECK-NEXT:  load i32, ptr @g,
+; CHECK-NEXT:  load i32, ptr @only_off,
+
+; CHECK-LABEL: define i32 @light(
+; CHECK-NOT:   {{obf_gep|mba_dec|plain_dec}}
+; CHECK:       %sub2_gef = getelementptr i8, ptr %g__encrypted
+; CHECK-NOT:   {{obf_gep|mba_dec|plain_dec}}
+; CHECK:       getelementptr i8, ptr %h__encrypted
+; CHECK-NOT:   {{obf_gep|mba_dec|plain_dec}}
+; CHECK:       ret i32
+
+target triple = "x86_64-pc-linux-gnu"
+
+@g = global i32 1
+@h = global i32 2
+@only_off = global i32 5
+@table = global [4 x i32] [i32 3, i32 5, i32 7, i32 11]
+@fmt = private unnamed_addr constant [25 x i8] c"off=%d light=%d full=%d\0A\00"
+@.off = private unnamed_addr constant [11 x i8] c"gvhide=off\00", section "llvm.metadata"
+@.light = private unnamed_addr constant [13 x i8] c"gvhide=light\00", section "llvm.metadata"
+@.full = private unnamed_addr constant [12 x i8] c"gvhide=full\00", section "llvm.metadata"
+@.file = private unnamed_addr constant [9 x i8] c"levels.c\00", section "llvm.metadata"
+@llvm.global.annotations = appending global [3 x { ptr, ptr, ptr, i32, ptr }] [{ ptr, ptr, ptr, i32, ptr } { ptr @off, ptr @.off, ptr @.file, i32 1, ptr null }, { ptr, ptr, ptr, i32, ptr } { ptr @light, ptr @.light, ptr @.file, i32 2, ptr null }, { ptr, ptr, ptr, i32, ptr } { ptr @full, ptr @.full, ptr @.file, i32 3, ptr null }], section "llvm.metadata"
+
+declare i32 @printf(ptr, ...)
+
+define i32 @off() {
+entry:
+  %a = load i32, ptr @g
+  %b = load i32, ptr @only_off
+  %c = add i32 %a, %b
+  ret i32 %c
+}
+
+define i32 @light() {
+entry:
+  %a = load i32, ptr @g
+  %b = load i32, ptr @h
+  %c = add i32 %a, %b
+  ret i32 %c
+}
+
+define i32 @full() {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %acc = phi i32 [ 0, %entry ], [ %acc.next, %loop ]
+  %p = getelementptr [4 x i32], ptr @table, i64 0, i64 %i
+  %v = load i32, ptr %p
+  %hv = load i32, ptr @h
+  %m = mul i32 %v, %hv
+  %acc.next = add i32 %acc, %m
+  %i.next = add i64 %i, 1
+  %done = icmp eq i64 %i.next, 4
+  br i1 %done, label %exit, label %loop
+
+exit:
+  %gv = load i32, ptr @g
+  %r = add i32 %acc.next, %gv
+  ret i32 %r
+}
+
+define i32 @main() {
+entry:
+  %a = call i32 @off()
+  %b = call i32 @light()
+  %c = call i32 @full()
+  %p = call i32 (ptr, ...) @printf(ptr @fmt, i32 %a, i32 %b, i32 %c)
+  ret i32 0
+}
@@ -0,0 +1,32 @@
+# lit configuration of the gvHide tests; loaded through the lit.site.cfg.py
+# CMake generates in the build directory.
+
+import os
+import platform
+
+import lit.formats
+
+config.name = "gvHide"
+config.test_format = lit.formats.ShTest(True)
+config.suffixes = [".ll", ".test"]
+config.excludes = ["Inputs"]
+config.test_source_root = os.path.dirname(__file__)
+config.test_exec_root = config.gvhide_obj_root
+
+config.environment["PATH"] = os.pathsep.join(
+    [config.llvm_tools_dir, config.environment.get("PATH", "")])
+
+plugin = config.gvhide_plugin
+opaque = config.opaque_pointers
+config.substitutions.append(
+    ("%gvopt", f"opt {opaque} -load {plugin} -load-pass-plugin {plugin}"))
+config.substitutions.append(("%lli", f"lli {opaque}"))
+config.substitutions.append(("%llc", f"llc {opaque}"))
+
+# the programs under Inputs are x86-64 and run with lli
+if platform.machine() in ("x86_64", "AMD64"):
+    config.available_features.add("x86_64-host")
+
+for version in (16, 20):
+    if config.llvm_version_major < version:
+        config.available_features.add(f"llvm-before-{version}")
@@ -0,0 +1,357 @@
+/// @file gvhide_tool.cc
+/// @brief Batch driver running the global value hiding pass over many
+/// bitcode files in one process.
+///
+/// Inputs are bitcode files, directories searched recursively for `.bc`
+/// files, or files listing one input per line (`-inputs-from`). Every module
+/// is read into its own LLVMContext, transformed on a worker pool and written
+/// under `-output-dir`: files by their name, files found in a directory by
+/// their path relative to it.
+///
+/// A module gets the same analyses as under `opt`, including a target machine
+/// for its triple, and keeps the path it was named by as module identifier,
+/// so with a fixed seed the output is bit-identical to
+/// `opt -passes=global-value-hide <path> -o <output>`.
+///
+/// Every `-gvhide-*` option of the pass is accepted as well.
+
+#include "gv_hide.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/InitLLVM.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/LineIterator.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/ThreadPool.h>
+#include <llvm/Support/Threading.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+static cl::list<std::string> Inputs(cl::Positional, cl::ZeroOrMore,
+                                    cl::desc("<bitcode files or directories>"));
+static cl::list<std::string>
+    InputLists("inputs-from",
+               cl::desc("File listing one input per line"),
+               cl::value_desc("filename"));
+static cl::opt<std::string> OutputDir("output-dir", cl::Required,
+                                      cl::desc("Directory of the outputs"),
+                                      cl::value_desc("directory"));
+static cl::opt<unsigned>
+    Jobs("j", cl::init(0),
+         cl::desc("Modules processed at once (0: one per hardware thread)"));
+static cl::opt<bool> Verify("verify", cl::init(false),
+                            cl::desc("Verify every module after the pass"));
+static cl::opt<std::string> Report("report",
+                                   cl::desc("Per-file JSON report"),
+                                   cl::value_desc("filename"));
+
+namespace {
+
+/// @brief One module to process.
+struct Job {
+  std::string input;  ///< Path the module is read from, and its identifier.
+  std::string output; ///< Path the result is written to.
+};
+
+/// @brief Outcome of one module.
+struct JobResult {
+  std::string error;             ///< Empty on success.
+  double readMs = 0;             ///< Parsing.
+  double passMs = 0;             ///< Pass, including analyses.
+  double writeMs = 0;            ///< Bitcode writing.
+  int64_t instructionsAdded = 0; ///< Instructions added by the pass.
+  size_t functionsChanged = 0;   ///< Functions the pass rewrote sites in.
+  bool changed = false;          ///< Whether the pass changed the module.
+};
+
+/// @brief Analysis managers wired up the way `opt` does it.
+struct Analyses {
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+
+  explicit Analyses(TargetMachine *TM) {
+    PassBuilder PB(TM);
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+  }
+};
+
+/// @brief Creates the target machine `opt` would use for a module.
+/// @return The target machine, or null if the triple has no registered
+/// target.
+std::unique_ptr<TargetMachine> createTargetMachine(const Module &M) {
+  Triple triple(M.getTargetTriple());
+  if (triple.getArch() == Triple::UnknownArch) {
+    return nullptr;
+  }
+
+  std::string error;
+  auto *target = TargetRegistry::lookupTarget(triple.str(), error);
+  if (!target) {
+    return nullptr;
+  }
+#if LLVM_VERSION_MAJOR >= 16
+  auto noModel = std::nullopt;
+#else
+  auto noModel = None;
+#endif
+#if LLVM_VERSION_MAJOR >= 18
+  auto optLevel = CodeGenOptLevel::Default;
+#else
+  auto optLevel = CodeGenOpt::Default;
+#endif
+  return std::unique_ptr<TargetMachine>(target->createTargetMachine(
+      triple.str(), "", "", TargetOptions(), noModel, noModel, optLevel));
+}
+
+int64_t countInstructions(const Module &M) {
+  int64_t count = 0;
+  for (auto &F : M) {
+    count += F.getInstructionCount();
+  }
+  return count;
+}
+
+double elapsedMs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+/// @brief Reads, transforms and writes one module.
+JobResult runJob(const Job &job) {
+  JobResult result;
+  LLVMContext ctx;
+
+  auto start = std::chrono::steady_clock::now();
+  SMDiagnostic diag;
+  auto M = parseIRFile(job.input, diag, ctx);
+  if (!M) {
+    raw_string_ostream OS(result.error);
+    diag.print(nullptr, OS, /*ShowColors=*/false);
+    return result;
+  }
+  result.readMs = elapsedMs(start);
+
+  start = std::chrono::steady_clock::now();
+  auto before = countInstructions(*M);
+  {
+    auto TM = createTargetMachine(*M);
+    Analyses analyses(TM.get());
+    global_value_hide::GlobalValHideManager manager(*M, &analyses.MAM);
+    manager.run();
+    result.changed = manager.changed();
+    result.functionsChanged = manager.changedFunctions().size();
+  }
+  result.instructionsAdded = countInstructions(*M) - before;
+  result.passMs = elapsedMs(start);
+
+  if (Verify && verifyModule(*M, nullptr)) {
+    result.error = "pass produced invalid IR";
+    return result;
+  }
+
+  start = std::chrono::steady_clock::now();
+  if (auto EC =
+          sys::fs::create_directories(sys::path::parent_path(job.output))) {
+    result.error = job.output + ": " + EC.message();
+    return result;
+  }
+  // a raw_fd_stream lets the writer flush as it goes instead of buffering
+  // the whole module
+  std::error_code EC;
+  raw_fd_stream out(job.output, EC);
+  if (EC) {
+    result.error = job.output + ": " + EC.message();
+    return result;
+  }
+  // opt preserves use-list order too
+  WriteBitcodeToFile(*M, out, /*ShouldPreserveUseListOrder=*/true);
+  out.close();
+  if (out.has_error()) {
+    result.error = job.output + ": " + out.error().message();
+    out.clear_error();
+    return result;
+  }
+  result.writeMs = elapsedMs(start);
+  return result;
+}
+
+/// @brief Adds the jobs of one input.
+/// @return Error message, or an empty string.
+std::string addInput(StringRef input, std::vector<Job> &jobs) {
+  auto outputFor = [](StringRef relative) {
+    SmallString<128> output(OutputDir);
+    sys::path::append(output, relative);
+    return std::string(output);
+  };
+
+  if (!sys::fs::is_directory(input)) {
+    jobs.push_back({input.str(), outputFor(sys::path::filename(input))});
+    return "";
+  }
+
+  std::vector<std::string> found;
+  std::error_code EC;
+  for (sys::fs::recursive_directory_iterator it(input, EC), end;
+       it != end && !EC; it.increment(EC)) {
+    if (sys::path::extension(it->path()) == ".bc" &&
+        it->type() != sys::fs::file_type::directory_file) {
+      found.push_back(it->path());
+    }
+  }
+  if (EC) {
+    return input.str() + ": " + EC.message();
+  }
+
+  // directory order is unspecified
+  std::sort(found.begin(), found.end());
+  for (auto &path : found) {
+    StringRef relative(path);
+    relative.consume_front(input);
+    relative = relative.ltrim(sys::path::get_separator());
+    jobs.push_back({path, outputFor(relative)});
+  }
+  return "";
+}
+
+/// @brief Collects the jobs of every input.
+/// @return Error message, or an empty string.
+std::string collectJobs(std::vector<Job> &jobs) {
+  std::vector<std::string> inputs(Inputs.begin(), Inputs.end());
+  for (auto &list : InputLists) {
+    auto buffer = MemoryBuffer::getFile(list);
+    if (!buffer) {
+      return list + ": " + buffer.getError().message();
+    }
+    for (line_iterator line(**buffer, /*SkipBlanks=*/true, '#');
+         !line.is_at_eof(); ++line) {
+      inputs.push_back(line->trim().str());
+    }
+  }
+
+  for (auto &input : inputs) {
+    if (auto error = addInput(input, jobs); !error.empty()) {
+      return error;
+    }
+  }
+
+  StringSet<> outputs;
+  for (auto &job : jobs) {
+    if (!outputs.insert(job.output).second) {
+      return "several inputs are written to " + job.output;
+    }
+  }
+  return "";
+}
+
+void writeReport(raw_ostream &OS, const std::vector<Job> &jobs,
+                 const std::vector<JobResult> &results) {
+  json::OStream J(OS, 2);
+  J.object([&] {
+    J.attribute("tool", "gvhide-tool");
+    J.attributeArray("files", [&] {
+      for (size_t i = 0; i < jobs.size(); ++i) {
+        auto &result = results[i];
+        J.object([&] {
+          J.attribute("input", jobs[i].input);
+          J.attribute("output", jobs[i].output);
+          if (!result.error.empty()) {
+            J.attribute("error", result.error);
+            return;
+          }
+          J.attribute("read_ms", result.readMs);
+          J.attribute("pass_ms", result.passMs);
+          J.attribute("write_ms", result.writeMs);
+          J.attribute("changed", result.changed);
+          J.attribute("functions_changed",
+                      static_cast<int64_t>(result.functionsChanged));
+          J.attribute("instructions_added", result.instructionsAdded);
+        });
+      }
+    });
+  });
+  OS << "\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  InitLLVM X(argc, argv);
+  InitializeAllTargetInfos();
+  InitializeAllTargets();
+  InitializeAllTargetMCs();
+  cl::ParseCommandLineOptions(argc, argv,
+                              "global value hide batch driver\n");
+
+  std::vector<Job> jobs;
+  if (auto error = collectJobs(jobs); !error.empty()) {
+    errs() << "gvhide-tool: " << error << "\n";
+    return 1;
+  }
+
+  std::vector<JobResult> results(jobs.size());
+  {
+    ThreadPool pool(hardware_concurrency(Jobs));
+    for (size_t i = 0; i < jobs.size(); ++i) {
+      pool.async([&jobs, &results, i] { results[i] = runJob(jobs[i]); });
+    }
+    pool.wait();
+  }
+
+  // printed in input order, whatever order the modules finished in
+  int status = 0;
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    auto &result = results[i];
+    if (!result.error.empty()) {
+      errs() << "gvhide-tool: " << jobs[i].input << ": "
+             << StringRef(result.error).rtrim() << "\n";
+      status = 1;
+      continue;
+    }
+    outs() << jobs[i].input << ": "
+           << format("%.1f ms", result.readMs + result.passMs + result.writeMs)
+           << " (pass " << format("%.1f ms", result.passMs) << "), "
+           << result.functionsChanged << " functions rewritten, "
+           << result.instructionsAdded << " instructions added\n";
+  }
+
+  if (!Report.empty()) {
+    std::error_code EC;
+    raw_fd_ostream OS(Report, EC, sys::fs::OF_Text);
+    if (EC) {
+      errs() << "gvhide-tool: " << Report << ": " << EC.message() << "\n";
+      return 1;
+    }
+    writeReport(OS, jobs, results);
+  }
+  return status;
+}
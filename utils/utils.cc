@@ -1,16 +1,54 @@
 #include "utils.h"
 #include <cstdint>
-#include <random>
 
 namespace utils {
 
+uint64_t hashCombine(uint64_t seed, std::string_view data) {
+  // FNV-1a
+  uint64_t hash = seed ^ 0xcbf29ce484222325ULL;
+  for (unsigned char c : data) {
+    hash ^= c;
+    hash *= 0x100000001b3ULL;
+  }
+
+  // splitmix64 finalizer
+  hash += 0x9e3779b97f4a7c15ULL;
+  hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+  return hash ^ (hash >> 31);
+}
+
+uint64_t hashCombine(uint64_t seed, uint64_t value) {
+  char bytes[sizeof(value)];
+  for (size_t i = 0; i < sizeof(value); ++i) {
+    bytes[i] = static_cast<char>(value >> (i * 8));
+  }
+  return hashCombine(seed, std::string_view(bytes, sizeof(bytes)));
+}
+
 uint8_t RandomEngine::getUint8() { return getRange(0, UINT8_MAX); }
 uint16_t RandomEngine::getUint16() { return getRange(0, UINT16_MAX); }
 uint32_t RandomEngine::getUint32() { return getRange(0, UINT32_MAX); }
 uint64_t RandomEngine::getUint64() { return getRange(0, UINT64_MAX); }
 uint64_t RandomEngine::getRange(uint64_t min_val, uint64_t max_val) {
-  dynamic_dist.param(decltype(dynamic_dist)::param_type(min_val, max_val));
-  return dynamic_dist(engine);
+  uint64_t span = max_val - min_val + 1;
+  if (span == 0) {
+    // the whole 64-bit range
+    return min_val + engine();
+  }
+
+  // the high half of x * span is uniform in [0, span) once the low halves
+  // that would overrepresent some values are rejected
+  unsigned __int128 product = (unsigned __int128)engine() * span;
+  uint64_t low = static_cast<uint64_t>(product);
+  if (low < span) {
+    uint64_t threshold = -span % span;
+    while (low < threshold) {
+      product = (unsigned __int128)engine() * span;
+      low = static_cast<uint64_t>(product);
+    }
+  }
+  return min_val + static_cast<uint64_t>(product >> 64);
 }
 
 } // namespace utils
\ No newline at end of file
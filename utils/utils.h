@@ -1,8 +1,9 @@
 #pragma once
 
 #include <cstdint>
-#include <random>
+#include <iterator>
 #include <stdexcept>
+#include <string_view>
 #include <vector>
 
 namespace utils {
@@ -25,18 +26,65 @@ int findElementIndex(const std::vector<T> &vec, const T &target) {
   return FIND_NOT_FOUND;
 }
 
+/// @brief Mix a string into a 64-bit hash state
+/// @details FNV-1a over the bytes followed by a splitmix64 finalizer. The
+/// result only depends on the inputs, so it is stable across runs, hosts and
+/// processes.
+/// @param seed Hash state to extend
+/// @param data Bytes to mix in
+/// @return New hash state
+uint64_t hashCombine(uint64_t seed, std::string_view data);
+
+/// @brief Mix an integer into a 64-bit hash state
+/// @param seed Hash state to extend
+/// @param value Integer to mix in
+/// @return New hash state
+uint64_t hashCombine(uint64_t seed, uint64_t value);
+
+/// @brief splitmix64 pseudo-random generator
+/// @details 64 bits of state, so seeding costs nothing, which matters because
+/// the pass derives a fresh engine for every key and decrypt site. Meets the
+/// UniformRandomBitGenerator requirements.
+class SplitMix64 {
+private:
+  uint64_t state;
+
+public:
+  using result_type = uint64_t;
+
+  /// @brief Construct a generator
+  /// @param seed Initial state; equal seeds yield equal sequences
+  explicit SplitMix64(uint64_t seed) : state(seed) {}
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return UINT64_MAX; }
+
+  /// @brief Generate the next 64-bit value
+  result_type operator()() {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+};
+
 /// @brief Random number generator utility class
-/// @details Provides thread-safe generation of various unsigned integer types
-/// using C++11 random library facilities. Supports 8/16/32/64-bit integers
-/// and custom ranges.
+/// @details Provides generation of various unsigned integer types on top of
+/// SplitMix64. Supports 8/16/32/64-bit integers and custom ranges. Ranges are
+/// mapped by the engine itself rather than by a standard distribution, whose
+/// output differs between standard libraries, so a seed gives the same
+/// values whatever the plugin was built with. An engine holds nothing but its
+/// generator state and is not shared: every draw derives its own from a seed,
+/// so engines used on different threads never touch common state.
 class RandomEngine {
 private:
-  std::mt19937_64 engine;
-  mutable std::uniform_int_distribution<uint64_t> dynamic_dist;
+  SplitMix64 engine;
 
 public:
-  /// @brief Construct a new RandomEngine with proper initialization
-  RandomEngine() : engine(std::random_device{}()) {}
+  /// @brief Construct a deterministic RandomEngine
+  /// @param seed Seed of the underlying engine; equal seeds yield equal
+  /// sequences
+  explicit RandomEngine(uint64_t seed) : engine(seed) {}
 
   /// @brief Generate random 8-bit unsigned integer
   /// @return Random value in [0, 255] range
@@ -58,6 +106,7 @@ public:
   /// @param minVal Inclusive lower bound of the range
   /// @param maxVal Inclusive upper bound of the range
   /// @return Random value in [begin, end] range
+  /// @note Multiply-shift with rejection (Lemire), which is unbiased.
   uint64_t getRange(uint64_t minVal, uint64_t maxVal);
 
   /// @brief Generate random element from a container
@@ -72,11 +121,8 @@ public:
         throw std::invalid_argument("Iterable cannot be empty.");
     }
   
-    using diff_type = typename std::iterator_traits<decltype(begin)>::difference_type;
     auto size = std::distance(begin, end);
-  
-    std::uniform_int_distribution<diff_type> dist(0, size - 1);
-    auto index = dist(engine);
+    auto index = getRange(0, static_cast<uint64_t>(size) - 1);
   
     std::advance(begin, index);
     return *begin;